@@ -5,41 +5,302 @@
 #include <sstream>
 #include <limits>
 #include <iomanip>
+#include <string_view>
+#include <cstring>
+#include <memory_resource>
+#include <charconv>
+#include <memory>
+#include <iterator>
+#include <future>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <unordered_map>
+#include <list>
+#include <map>
+#include <set>
+#include <tuple>
+#include <random>
+#include <thread>
+#include <cctype>
+#include <atomic>
+#include <cerrno>
+#include <ctime>
+#include <filesystem>
+#include <array>
+#include <numeric>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
-// Simple utility to trim whitespace from both ends of a string
-static std::string trim(const std::string& s) {
+// Simple utility to trim whitespace from both ends of a string.
+// Returns a view into the argument, so no copy is made.
+static std::string_view trim(std::string_view s) {
     size_t a = s.find_first_not_of(" \t\r\n");
     size_t b = s.find_last_not_of(" \t\r\n");
-    if (a == std::string::npos) return "";
+    if (a == std::string_view::npos) return {};
     return s.substr(a, b - a + 1);
 }
 
-// Task represents a single to-do item
+// Parse a leading integer like std::stoi would (leading blanks allowed,
+// trailing text ignored) but straight from a view
+static bool parseInt(std::string_view s, int& out) {
+    size_t a = s.find_first_not_of(" \t");
+    if (a == std::string_view::npos) return false;
+    const char* first = s.data() + a;
+    if (*first == '+') ++first;
+    auto res = std::from_chars(first, s.data() + s.size(), out);
+    return res.ec == std::errc();
+}
+
+// InlineString stores up to N characters inside the object itself and only
+// spills to its memory resource for longer text. The last byte holds the
+// remaining inline capacity, so a full inline string doubles as its own
+// terminator; a value of kHeap marks spilled storage (pointer and size kept
+// up front).
+template <std::size_t N>
+class InlineString {
+    static_assert(N >= sizeof(char*) + sizeof(std::size_t) && N < 0x7F,
+                  "inline capacity must hold the heap header and fit a byte");
+    static constexpr unsigned char kHeap = 0xFF;
+
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+private:
+    allocator_type alloc;
+    alignas(sizeof(char*)) char raw[N + 1];
+
+    bool onHeap() const { return static_cast<unsigned char>(raw[N]) == kHeap; }
+
+    char* heapPtr() const {
+        char* p;
+        std::memcpy(&p, raw, sizeof p);
+        return p;
+    }
+
+    std::size_t heapSize() const {
+        std::size_t n;
+        std::memcpy(&n, raw + sizeof(char*), sizeof n);
+        return n;
+    }
+
+    void setEmpty() {
+        raw[0] = '\0';
+        raw[N] = static_cast<char>(N);
+    }
+
+    void release(char* p, std::size_t n) {
+        if (p) alloc.deallocate(p, n + 1);
+    }
+
+    void assign(std::string_view s) {
+        // The source may live in our own buffer, so free the old heap block last
+        char* old = onHeap() ? heapPtr() : nullptr;
+        std::size_t oldSize = old ? heapSize() : 0;
+        if (s.size() <= N) {
+            if (!s.empty()) std::memmove(raw, s.data(), s.size());
+            raw[s.size()] = '\0';
+            raw[N] = static_cast<char>(N - s.size());
+        } else {
+            char* p = alloc.allocate(s.size() + 1);
+            std::memcpy(p, s.data(), s.size());
+            p[s.size()] = '\0';
+            std::size_t n = s.size();
+            std::memcpy(raw, &p, sizeof p);
+            std::memcpy(raw + sizeof(char*), &n, sizeof n);
+            raw[N] = static_cast<char>(kHeap);
+        }
+        release(old, oldSize);
+    }
+
+    void steal(InlineString& other) {
+        std::memcpy(raw, other.raw, sizeof raw);
+        other.setEmpty();
+    }
+
+public:
+    static constexpr std::size_t inlineCapacity = N;
+
+    InlineString() { setEmpty(); }
+    explicit InlineString(const allocator_type& a) : alloc(a) { setEmpty(); }
+    InlineString(std::string_view s, const allocator_type& a = {}) : alloc(a) {
+        setEmpty();
+        assign(s);
+    }
+    InlineString(const InlineString& other) { setEmpty(); assign(other.view()); }
+    InlineString(const InlineString& other, const allocator_type& a) : alloc(a) {
+        setEmpty();
+        assign(other.view());
+    }
+    InlineString(InlineString&& other) noexcept : alloc(other.alloc) { steal(other); }
+    InlineString(InlineString&& other, const allocator_type& a) : alloc(a) {
+        setEmpty();
+        if (alloc == other.alloc) steal(other);
+        else assign(other.view());
+    }
+    ~InlineString() {
+        if (onHeap()) release(heapPtr(), heapSize());
+    }
+
+    InlineString& operator=(const InlineString& other) {
+        if (this != &other) assign(other.view());
+        return *this;
+    }
+
+    // Like std::pmr::string, the allocator stays put; storage is only
+    // stolen when both sides share a resource. Otherwise the text is
+    // copied, which may allocate, so this is only noexcept for allocators
+    // that move along or always compare equal (never for polymorphic ones).
+    InlineString& operator=(InlineString&& other) noexcept(
+        std::allocator_traits<allocator_type>::propagate_on_container_move_assignment::value
+        || std::allocator_traits<allocator_type>::is_always_equal::value) {
+        if (this == &other) return *this;
+        if (alloc == other.alloc) {
+            if (onHeap()) release(heapPtr(), heapSize());
+            steal(other);
+        } else {
+            assign(other.view());
+        }
+        return *this;
+    }
+
+    InlineString& operator=(std::string_view s) {
+        assign(s);
+        return *this;
+    }
+
+    allocator_type get_allocator() const { return alloc; }
+
+    const char* data() const { return onHeap() ? heapPtr() : raw; }
+    std::size_t size() const {
+        return onHeap() ? heapSize() : N - static_cast<unsigned char>(raw[N]);
+    }
+    bool empty() const { return size() == 0; }
+    bool isInline() const { return !onHeap(); }
+
+    std::string_view view() const { return std::string_view(data(), size()); }
+    operator std::string_view() const { return view(); }
+};
+
+// Titles are usually a few words, so 31 characters covers nearly all of them
+// without touching the heap and keeps the title next to id and status.
+using TitleString = InlineString<31>;
+
+// Record formats for task files. Escaped is the original one: commas in
+// fields become "\," and newlines are flattened to spaces. Rfc4180 quotes
+// the title and notes, doubling embedded quotes, so commas, quotes and
+// line breaks survive exactly and other CSV tools can read the file.
+enum class CsvDialect { Escaped, Rfc4180 };
+
+class BlobStore;
+
+// Task represents a single to-do item. It is allocator-aware so that tasks
+// stored in a std::pmr container draw their strings from the same resource.
 class Task {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
 private:
     int id;                // unique id for stable selection
-    std::string title;     // short title
-    std::string notes;     // optional details
     bool completed;        // completion status
+    uint64_t version = 1;  // bumped on every change, for compare-and-set
+    TitleString title;     // short title, stored inline when it fits
+    std::pmr::string notes; // optional details, or a blob marker (see BlobStore)
+    std::shared_ptr<const BlobStore> blobs;  // set while notes are out of line
 
 public:
     Task() : id(-1), completed(false) {}
 
-    Task(int id_, const std::string& title_, const std::string& notes_, bool completed_ = false)
-        : id(id_), title(title_), notes(notes_), completed(completed_) {}
+    explicit Task(const allocator_type& alloc)
+        : id(-1), completed(false), title(alloc), notes(alloc) {}
+
+    Task(int id_, std::string_view title_, std::string_view notes_, bool completed_ = false,
+         const allocator_type& alloc = {})
+        : id(id_), completed(completed_), title(title_, alloc), notes(notes_, alloc) {}
+
+    // Takes the strings over when they already use alloc's resource
+    Task(int id_, TitleString&& title_, std::pmr::string&& notes_, bool completed_, const allocator_type& alloc)
+        : id(id_), completed(completed_), title(std::move(title_), alloc), notes(std::move(notes_), alloc) {}
+
+    Task(const Task&) = default;
+    Task(Task&&) noexcept = default;
+    Task& operator=(const Task&) = default;
+    Task& operator=(Task&&) = default;
+
+    Task(const Task& other, const allocator_type& alloc)
+        : id(other.id), completed(other.completed), version(other.version),
+          title(other.title, alloc), notes(other.notes, alloc), blobs(other.blobs) {}
+
+    Task(Task&& other, const allocator_type& alloc)
+        : id(other.id), completed(other.completed), version(other.version),
+          title(std::move(other.title), alloc), notes(std::move(other.notes), alloc),
+          blobs(std::move(other.blobs)) {}
+
+    allocator_type get_allocator() const { return notes.get_allocator(); }
 
     int getId() const { return id; }
-    const std::string& getTitle() const { return title; }
-    const std::string& getNotes() const { return notes; }
+    std::string_view getTitle() const { return title.view(); }
+    // Out-of-line notes are read from their blob file on first use
+    std::string_view getNotes() const;
+    // The notes, or false if they are out of line and cannot be read
+    bool readNotes(std::string_view& text) const;
+    bool notesOutOfLine() const { return blobs != nullptr; }
+    // The notes as stored: the text itself or its blob marker
+    std::string_view storedNotes() const { return notes; }
     bool isCompleted() const { return completed; }
+    uint64_t getVersion() const { return version; }
+
+    // Bytes this task holds outside its own footprint
+    size_t heapBytes() const {
+        static const size_t sso = std::pmr::string().capacity();
+        return (title.isInline() ? 0 : title.size() + 1)
+             + (notes.capacity() > sso ? notes.capacity() + 1 : 0);
+    }
+
+    // Move the title and notes out, reading notes kept in a blob
+    void takeStrings(TitleString& t, std::pmr::string& n) {
+        t = std::move(title);
+        if (blobs) n = getNotes();
+        else n = std::move(notes);
+    }
+
+    void setTitle(std::string_view t) { title = t; }
+    void setNotes(std::string_view n) {
+        notes = n;
+        blobs.reset();
+    }
 
-    void setTitle(const std::string& t) { title = t; }
-    void setNotes(const std::string& n) { notes = n; }
+    // Refer to notes kept in a blob store; marker is BlobStore::marker()
+    void setNotesRef(std::shared_ptr<const BlobStore> store, std::string_view marker) {
+        notes = marker;
+        blobs = std::move(store);
+    }
+    void setId(int newId) { id = newId; }
     void setCompleted(bool c) { completed = c; }
+    void bumpVersion() { ++version; }
+    void setVersion(uint64_t v) { version = v; }
 
-    // Serialize as a simple CSV line: id,completed,title,notes
-    // Commas in fields are escaped as "\,"
-    static std::string escapeCommas(const std::string& in) {
+    // Escaped dialect: commas in fields become "\,"
+    static std::string escapeCommas(std::string_view in) {
         std::string out;
         out.reserve(in.size());
         for (char c : in) {
@@ -69,211 +330,8471 @@ public:
         return out;
     }
 
-    std::string toCsv() const {
-        std::ostringstream oss;
-        oss << id << "," << (completed ? 1 : 0) << ","
-            << escapeCommas(title) << ","
-            << escapeCommas(notes);
-        return oss.str();
-    }
-
-    static bool fromCsv(const std::string& line, Task& outTask) {
-        // Split into 4 parts: id, completed, title, notes
-        std::vector<std::string> parts;
-        parts.reserve(4);
-
-        std::string current;
-        bool escape = false;
-        for (size_t i = 0; i < line.size(); ++i) {
-            char c = line[i];
-            if (escape) {
-                // keep escaped comma as literal comma
-                current.push_back(c);
-                escape = false;
-            } else if (c == '\\') {
-                // mark next char as escaped
-                escape = true;
-            } else if (c == ',') {
-                parts.push_back(current);
-                current.clear();
-            } else {
-                current.push_back(c);
-            }
+    // Wrap a field in quotes, doubling the quotes inside (RFC 4180)
+    static std::string quoteField(std::string_view in) {
+        std::string out;
+        out.reserve(in.size() + 2);
+        out += '"';
+        for (char c : in) {
+            if (c == '"') out += '"';
+            out += c;
         }
-        parts.push_back(current);
+        out += '"';
+        return out;
+    }
 
-        if (parts.size() < 4) return false;
-        try {
-            int id = std::stoi(parts[0]);
-            bool completed = (std::stoi(parts[1]) != 0);
-            std::string title = unescapeCommas(parts[2]);
-            std::string notes = unescapeCommas(parts[3]);
-            outTask = Task(id, title, notes, completed);
-            return true;
-        } catch (...) {
-            return false;
+    // Undo quoteField. Unquoted fields are returned as they are.
+    static std::string_view unquoteField(std::string_view field, std::string& scratch) {
+        if (field.size() < 2 || field.front() != '"' || field.back() != '"') return field;
+        field = field.substr(1, field.size() - 2);
+        if (field.find('"') == std::string_view::npos) return field;
+        scratch.clear();
+        for (size_t i = 0; i < field.size(); ++i) {
+            scratch.push_back(field[i]);
+            if (field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"') ++i;
         }
+        return scratch;
     }
-};
 
-// TaskManager owns the list of tasks and provides operations
-class TaskManager {
-private:
-    std::vector<Task> tasks;
-    int nextId;
-    std::string savePath;
+    // Like splitFields for the quoted dialect: commas inside quotes do not
+    // split, and the last field runs to the end of the record.
+    static bool splitQuoted(std::string_view line, std::string_view* parts, size_t n) {
+        size_t count = 0;
+        size_t start = 0;
+        bool quoted = false;
+        for (size_t i = 0; i < line.size() && count + 1 < n; ++i) {
+            if (line[i] == '"') {
+                quoted = !quoted;
+            } else if (line[i] == ',' && !quoted) {
+                parts[count++] = line.substr(start, i - start);
+                start = i + 1;
+            }
+        }
+        if (count + 1 < n) return false;
+        parts[count] = line.substr(std::min(start, line.size()));
+        return true;
+    }
 
-    int generateId() { return nextId++; }
+    // A quoted-dialect record may span lines; it is complete once its
+    // quotes pair up
+    static bool quotesBalanced(std::string_view text) {
+        return std::count(text.begin(), text.end(), '"') % 2 == 0;
+    }
 
-public:
-    explicit TaskManager(const std::string& filePath = "tasks.csv")
-        : nextId(1), savePath(filePath) {}
+    // Which dialect a file uses, judged by its first record: the quoted
+    // dialect always quotes both text fields
+    static CsvDialect detectDialect(std::string_view record) {
+        std::string_view f[4];
+        auto quoted = [](std::string_view s) { return s.size() >= 2 && s.front() == '"' && s.back() == '"'; };
+        record = trim(record);
+        if (!splitQuoted(record, f, 4)) {
+            // Too few fields on this line: only a quoted title running on to
+            // the next line explains that
+            return splitQuoted(record, f, 3) && !f[2].empty() && f[2].front() == '"' && !quotesBalanced(record)
+                       ? CsvDialect::Rfc4180
+                       : CsvDialect::Escaped;
+        }
+        // Only the notes' opening quote is checked: they may go on past this line
+        return quoted(f[2]) && !f[3].empty() && f[3].front() == '"' ? CsvDialect::Rfc4180 : CsvDialect::Escaped;
+    }
 
-    // Load tasks from disk if present
-    bool load() {
-        std::ifstream in(savePath);
-        if (!in.is_open()) {
-            // File may not exist on first run
-            return false;
+    // Serialize as one record: id,completed,title,notes
+    std::string toCsv(CsvDialect dialect = CsvDialect::Rfc4180) const {
+        std::string out = std::to_string(id);
+        out += completed ? ",1," : ",0,";
+        if (dialect == CsvDialect::Rfc4180) {
+            out += quoteField(title);
+            out += ',';
+            out += quoteField(notes);
+        } else {
+            out += escapeCommas(title);
+            out += ',';
+            out += escapeCommas(notes);
         }
-        tasks.clear();
-        std::string line;
-        int maxSeen = 0;
-        while (std::getline(in, line)) {
-            line = trim(line);
-            if (line.empty()) continue;
-            Task t;
-            if (Task::fromCsv(line, t)) {
-                tasks.push_back(t);
-                if (t.getId() > maxSeen) maxSeen = t.getId();
+        return out;
+    }
+
+    // Decode a field written by escapeCommas: a backslash keeps the next
+    // character literally. Fields without a backslash are used as-is.
+    static std::string_view decodeField(std::string_view field, std::string& scratch) {
+        if (field.find('\\') == std::string_view::npos) return field;
+        scratch.clear();
+        for (size_t i = 0; i < field.size(); ++i) {
+            if (field[i] == '\\') {
+                if (++i == field.size()) break;
             }
+            scratch.push_back(field[i]);
         }
-        nextId = maxSeen + 1;
-        return true;
+        return scratch;
     }
 
-    // Save tasks to disk
-    bool save() const {
-        std::ofstream out(savePath, std::ios::trunc);
-        if (!out.is_open()) return false;
-        for (const auto& t : tasks) {
-            out << t.toCsv() << "\n";
+    // Split an escaped line into n fields. The last field runs to the end of
+    // the line, so it may contain further (escaped) commas.
+    static bool splitFields(std::string_view line, std::string_view* parts, size_t n) {
+        size_t count = 0;
+        size_t start = 0;
+        for (size_t i = 0; i < line.size() && count + 1 < n; ++i) {
+            if (line[i] == '\\') {
+                // skip the escaped character
+                ++i;
+            } else if (line[i] == ',') {
+                parts[count++] = line.substr(start, i - start);
+                start = i + 1;
+            }
         }
+        if (count + 1 < n) return false;
+        parts[count] = line.substr(std::min(start, line.size()));
         return true;
     }
 
-    // CRUD operations
-    int addTask(const std::string& title, const std::string& notes) {
-        Task t(generateId(), title, notes, false);
-        tasks.push_back(t);
-        return t.getId();
+    // Decode one text field of the given dialect
+    static std::string_view decodeField(std::string_view field, std::string& scratch, CsvDialect dialect) {
+        return dialect == CsvDialect::Rfc4180 ? unquoteField(field, scratch) : decodeField(field, scratch);
     }
 
-    bool removeById(int id) {
-        for (size_t i = 0; i < tasks.size(); ++i) {
-            if (tasks[i].getId() == id) {
-                tasks.erase(tasks.begin() + static_cast<long>(i));
-                return true;
+    // Fill outTask from the four fields of a record: id, completed, title,
+    // notes. Each stored string is allocated once, in outTask's resource.
+    static bool fromFields(const std::string_view* parts, Task& outTask, CsvDialect dialect) {
+        int id = 0;
+        int completedFlag = 0;
+        if (!parseInt(parts[0], id) || !parseInt(parts[1], completedFlag)) return false;
+
+        thread_local std::string scratch;
+        outTask.id = id;
+        outTask.completed = (completedFlag != 0);
+        outTask.title = decodeField(parts[2], scratch, dialect);
+        outTask.setNotes(decodeField(parts[3], scratch, dialect));
+        return true;
+    }
+
+    // Parse straight into outTask: fields are located as views into the line
+    static bool fromCsv(std::string_view line, Task& outTask, CsvDialect dialect = CsvDialect::Rfc4180) {
+        std::string_view parts[4];
+        bool split = dialect == CsvDialect::Rfc4180 ? splitQuoted(line, parts, 4) : splitFields(line, parts, 4);
+        return split && fromFields(parts, outTask, dialect);
+    }
+};
+
+// Read one quoted-dialect record from a stream, joining lines while a
+// quote is open. A record still open at end of input is rejected.
+static bool readCsvRecord(std::istream& in, std::string& record) {
+    if (!std::getline(in, record)) return false;
+    std::string more;
+    while (!Task::quotesBalanced(record)) {
+        if (!std::getline(in, more)) return false;
+        record += '\n';
+        record += more;
+    }
+    return true;
+}
+
+// Bit counts on 64-bit words: compiler builtins on GCC and Clang, bit scan
+// intrinsics on MSVC, plain arithmetic elsewhere. countTrailingZeros and
+// highestBit need a nonzero word.
+static unsigned countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return static_cast<unsigned>(i);
+#else
+    unsigned n = 0;
+    for (; !(x & 1); x >>= 1) ++n;
+    return n;
+#endif
+}
+
+// Index of the top set bit, floor(log2(x))
+static unsigned highestBit(uint64_t x) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(63 - __builtin_clzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long i;
+    _BitScanReverse64(&i, x);
+    return static_cast<unsigned>(i);
+#else
+    unsigned n = 0;
+    while (x >>= 1) ++n;
+    return n;
+#endif
+}
+
+// The POPCNT instruction is not on every x64 CPU, so MSVC gets the
+// arithmetic version rather than __popcnt64
+static unsigned popCount(uint64_t x) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+    x -= (x >> 1) & 0x5555555555555555ULL;
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<unsigned>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// CsvScanner finds the structural characters of a quoted-dialect buffer,
+// the commas and newlines outside quotes, 64 bytes at a time. Each block
+// gets one bitmask per character class (SSE2 compares where available);
+// the in-quote mask is then the prefix XOR of the quote bits, done as a
+// carry-less multiply by all ones when the CPU has PCLMUL and by shifts
+// otherwise, with the state carried into the next block. A doubled quote
+// flips the mask twice, so escaped quotes need no special case.
+class CsvScanner {
+    struct Masks {
+        uint64_t quote = 0;
+        uint64_t comma = 0;
+        uint64_t newline = 0;
+    };
+
+    static Masks classify(const char* p) {
+        Masks m;
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i comma = _mm_set1_epi8(',');
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (int i = 0; i < 4; ++i) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i));
+            auto bits = [&](__m128i c) {
+                return static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, c))))
+                       << (16 * i);
+            };
+            m.quote |= bits(quote);
+            m.comma |= bits(comma);
+            m.newline |= bits(newline);
+        }
+#else
+        for (int i = 0; i < 64; ++i) {
+            uint64_t bit = uint64_t(1) << i;
+            if (p[i] == '"') m.quote |= bit;
+            else if (p[i] == ',') m.comma |= bit;
+            else if (p[i] == '\n') m.newline |= bit;
+        }
+#endif
+        return m;
+    }
+
+    // Bit i of the result is the XOR of bits 0..i
+    static uint64_t prefixXor(uint64_t bits) {
+#if defined(__PCLMUL__)
+        __m128i product = _mm_clmulepi64_si128(_mm_set_epi64x(0, static_cast<long long>(bits)),
+                                               _mm_set1_epi8(static_cast<char>(0xFF)), 0);
+        return static_cast<uint64_t>(_mm_cvtsi128_si64(product));
+#else
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+#endif
+    }
+
+public:
+    // Call fn(offset, c) for each structural ',' or '\n' in order
+    template <typename Fn>
+    static void scan(std::string_view buf, Fn fn) {
+        uint64_t carry = 0;  // all ones while a quote is open
+        char tail[64];
+        for (size_t base = 0; base < buf.size(); base += 64) {
+            const char* p = buf.data() + base;
+            if (buf.size() - base < 64) {
+                std::memset(tail, 0, sizeof tail);
+                std::memcpy(tail, p, buf.size() - base);
+                p = tail;
+            }
+            Masks m = classify(p);
+            uint64_t inside = prefixXor(m.quote) ^ carry;
+            carry = static_cast<uint64_t>(static_cast<int64_t>(inside) >> 63);
+            uint64_t structural = (m.comma | m.newline) & ~inside;
+            while (structural) {
+                unsigned i = countTrailingZeros(structural);
+                fn(base + i, (m.comma >> i) & 1 ? ',' : '\n');
+                structural &= structural - 1;
             }
         }
-        return false;
     }
+};
 
-    bool toggleComplete(int id) {
-        for (auto& t : tasks) {
-            if (t.getId() == id) {
-                t.setCompleted(!t.isCompleted());
-                return true;
+// Tasks are stored in fixed-size chunks that are shared by reference count.
+// A snapshot copies only the chunk pointers; the store clones a chunk the
+// first time it writes to one that a snapshot still holds.
+constexpr size_t kTaskChunkSize = 64;
+
+// TaskChunk holds up to kTaskChunkSize tasks together with the CSV lines
+// last encoded for them, packed in one buffer. Writable access to a slot
+// marks its line stale, so a save re-encodes only tasks edited since the
+// previous one and gathers the rest as stored bytes.
+class TaskChunk : private std::pmr::vector<Task> {
+    using Base = std::pmr::vector<Task>;
+
+    // Where a task's line sits in `lines`; length 0 means not encoded
+    struct Span {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    mutable std::mutex linesMutex;
+    mutable std::pmr::string lines;
+    mutable std::pmr::vector<Span> spans;
+
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<Task>;
+    using Base::begin;
+    using Base::capacity;
+    using Base::empty;
+    using Base::end;
+    using Base::reserve;
+    using Base::size;
+
+    explicit TaskChunk(const allocator_type& alloc = {})
+        : Base(alloc), lines(alloc.resource()), spans(alloc.resource()) {}
+
+    TaskChunk(const TaskChunk&) = delete;
+    TaskChunk& operator=(const TaskChunk&) = delete;
+
+    const Task& operator[](size_t slot) const { return Base::operator[](slot); }
+
+    Task& mutableAt(size_t slot) {
+        spans[slot] = Span{};
+        return Base::operator[](slot);
+    }
+
+    template <typename... Args>
+    Task& emplace_back(Args&&... args) {
+        spans.emplace_back();
+        return Base::emplace_back(std::forward<Args>(args)...);
+    }
+
+    void pop_back() {
+        Base::pop_back();
+        spans.pop_back();
+    }
+
+    void eraseAt(size_t slot) {
+        Base::erase(Base::begin() + static_cast<long>(slot));
+        spans.erase(spans.begin() + static_cast<long>(slot));
+    }
+
+    // Move a task (and its line) down to an earlier slot while compacting
+    void moveSlot(size_t from, size_t to) {
+        Base::operator[](to) = std::move(Base::operator[](from));
+        spans[to] = spans[from];
+    }
+
+    void truncate(size_t n) {
+        Base::erase(Base::begin() + static_cast<long>(n), Base::end());
+        spans.resize(n);
+    }
+
+    // Copy-on-write clone; encoded lines come along
+    void assignFrom(const TaskChunk& other) {
+        Base::assign(other.begin(), other.end());
+        std::lock_guard<std::mutex> lock(other.linesMutex);
+        lines = other.lines;
+        spans = other.spans;
+    }
+
+    // All tasks as "\n"-terminated CSV lines, in slot order. Stale lines are
+    // encoded and the buffer repacked; safe to call from a saving thread.
+    std::string_view encoded() const {
+        std::lock_guard<std::mutex> lock(linesMutex);
+        bool packed = true;
+        size_t at = 0;
+        for (const Span& s : spans) {
+            packed = packed && s.length != 0 && s.offset == at;
+            at += s.length;
+        }
+        if (packed && at == lines.size()) return lines;
+        std::pmr::string fresh(lines.get_allocator());
+        fresh.reserve(lines.size());
+        for (size_t slot = 0; slot < spans.size(); ++slot) {
+            Span& s = spans[slot];
+            size_t start = fresh.size();
+            if (s.length != 0) {
+                fresh.append(lines, s.offset, s.length);
+            } else {
+                fresh += (*this)[slot].toCsv();
+                fresh += '\n';
             }
+            s.offset = static_cast<uint32_t>(start);
+            s.length = static_cast<uint32_t>(fresh.size() - start);
         }
-        return false;
+        lines.swap(fresh);
+        return lines;
     }
 
-    bool editTask(int id, const std::string& newTitle, const std::string& newNotes) {
-        for (auto& t : tasks) {
-            if (t.getId() == id) {
-                if (!newTitle.empty()) t.setTitle(newTitle);
-                if (!newNotes.empty()) t.setNotes(newNotes);
-                return true;
+    size_t encodedBytes() const {
+        std::lock_guard<std::mutex> lock(linesMutex);
+        return lines.capacity() + spans.capacity() * sizeof(Span);
+    }
+};
+
+// TaskSnapshot is a frozen, read-only view of the task list. It stays valid
+// and unchanged however the manager is edited afterwards, so it can be
+// handed to another thread for saving or exporting.
+class TaskSnapshot {
+public:
+    using ChunkList = std::pmr::vector<std::shared_ptr<const TaskChunk>>;
+
+    class const_iterator {
+        const std::shared_ptr<const TaskChunk>* chunk;
+        size_t slot;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Task;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Task*;
+        using reference = const Task&;
+
+        const_iterator(const std::shared_ptr<const TaskChunk>* c, size_t s) : chunk(c), slot(s) {}
+
+        reference operator*() const { return (**chunk)[slot]; }
+        pointer operator->() const { return &(**chunk)[slot]; }
+
+        const_iterator& operator++() {
+            if (++slot == (*chunk)->size()) {
+                ++chunk;
+                slot = 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const const_iterator& o) const { return chunk == o.chunk && slot == o.slot; }
+        bool operator!=(const const_iterator& o) const { return !(*this == o); }
+    };
+
+    TaskSnapshot() = default;
+    TaskSnapshot(ChunkList chunks_, size_t count_) : chunks(std::move(chunks_)), count(count_) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t chunkCount() const { return chunks.size(); }
+
+    const_iterator begin() const { return const_iterator(chunks.data(), 0); }
+    const_iterator end() const { return const_iterator(chunks.data() + chunks.size(), 0); }
+
+    // The chunks themselves, for writers that work a chunk at a time
+    const ChunkList& chunkList() const { return chunks; }
+
+private:
+    ChunkList chunks;
+    size_t count = 0;
+};
+
+// TaskStore is the mutable side: an ordered list of tasks kept in chunks of
+// at most kTaskChunkSize. Chunks never stay empty, so iteration can step
+// from the end of one chunk straight into the next.
+class TaskStore {
+    using ChunkPtr = std::shared_ptr<TaskChunk>;
+
+    std::pmr::vector<ChunkPtr> chunks;
+    size_t count = 0;
+    int highestId = std::numeric_limits<int>::min();  // no stored id is above this
+
+    std::pmr::polymorphic_allocator<TaskChunk> chunkAlloc() const {
+        return chunks.get_allocator().resource();
+    }
+
+    ChunkPtr newChunk() const {
+        ChunkPtr c = std::allocate_shared<TaskChunk>(chunkAlloc());
+        c->reserve(kTaskChunkSize);
+        return c;
+    }
+
+    // Get a chunk for writing, cloning it first if a snapshot shares it
+    TaskChunk& writable(size_t ci) {
+        ChunkPtr& c = chunks[ci];
+        if (c.use_count() > 1) {
+            ChunkPtr copy = newChunk();
+            copy->assignFrom(*c);
+            c = std::move(copy);
+        }
+        return *c;
+    }
+
+    bool locate(int id, size_t& ci, size_t& slot) const {
+        // New ids come from a counter, so an add's id is above every stored
+        // one and is known absent without a scan
+        if (id > highestId) return false;
+        for (ci = 0; ci < chunks.size(); ++ci) {
+            const TaskChunk& c = *chunks[ci];
+            for (slot = 0; slot < c.size(); ++slot) {
+                if (c[slot].getId() == id) return true;
             }
         }
         return false;
     }
 
-    const std::vector<Task>& list() const { return tasks; }
+public:
+    explicit TaskStore(std::pmr::memory_resource* resource) : chunks(resource) {}
 
-    bool clearAll() {
-        tasks.clear();
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    std::pmr::memory_resource* resource() const { return chunks.get_allocator().resource(); }
+
+    template <typename... Args>
+    Task& emplace_back(Args&&... args) {
+        if (chunks.empty() || chunks.back()->size() == kTaskChunkSize) {
+            chunks.push_back(newChunk());
+        }
+        Task& t = writable(chunks.size() - 1).emplace_back(std::forward<Args>(args)...);
+        ++count;
+        highestId = std::max(highestId, t.getId());
+        return t;
+    }
+
+    // A task filled in place after emplace_back() got its id late; make
+    // sure lookups still reach it
+    void noteId(int id) { highestId = std::max(highestId, id); }
+
+    void pop_back() {
+        TaskChunk& c = writable(chunks.size() - 1);
+        c.pop_back();
+        if (c.empty()) chunks.pop_back();
+        --count;
+    }
+
+    const Task* find(int id) const {
+        size_t ci, slot;
+        return locate(id, ci, slot) ? &(*chunks[ci])[slot] : nullptr;
+    }
+
+    Task* findMutable(int id) {
+        size_t ci, slot;
+        return locate(id, ci, slot) ? &writable(ci).mutableAt(slot) : nullptr;
+    }
+
+    bool erase(int id) {
+        size_t ci, slot;
+        if (!locate(id, ci, slot)) return false;
+        TaskChunk& c = writable(ci);
+        c.eraseAt(slot);
+        if (c.empty()) chunks.erase(chunks.begin() + static_cast<long>(ci));
+        --count;
         return true;
     }
-};
 
-// Input helpers
-static int readInt(const std::string& prompt) {
-    while (true) {
-        std::cout << prompt;
-        int value;
-        if (std::cin >> value) {
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-            return value;
+    void clear() {
+        chunks.clear();
+        count = 0;
+        highestId = std::numeric_limits<int>::min();
+    }
+
+    // Approximate bytes held, counting chunk storage and spilled strings
+    size_t memoryUsage() const {
+        size_t bytes = chunks.capacity() * sizeof(ChunkPtr);
+        for (const auto& c : chunks) {
+            bytes += sizeof(TaskChunk) + c->capacity() * sizeof(Task) + c->encodedBytes();
+            for (const auto& t : *c) bytes += t.heapBytes();
         }
-        std::cout << "Invalid number. Try again.\n";
-        std::cin.clear();
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return bytes;
     }
-}
 
-static std::string readLine(const std::string& prompt) {
-    std::cout << prompt;
-    std::string s;
-    std::getline(std::cin, s);
-    return trim(s);
-}
+    // Visit each task for which wanted(id) holds; fn edits it in place and
+    // returns false to drop it. Chunks with no wanted task are not copied.
+    template <typename Wanted, typename Fn>
+    void patchEach(Wanted wanted, Fn fn) {
+        for (size_t ci = 0; ci < chunks.size();) {
+            const TaskChunk& shared = *chunks[ci];
+            bool hit = std::any_of(shared.begin(), shared.end(),
+                                   [&](const Task& t) { return wanted(t.getId()); });
+            if (!hit) {
+                ++ci;
+                continue;
+            }
+            TaskChunk& c = writable(ci);
+            size_t kept = 0;
+            for (size_t i = 0; i < c.size(); ++i) {
+                if (wanted(c[i].getId()) && !fn(c.mutableAt(i))) continue;
+                if (kept != i) c.moveSlot(i, kept);
+                ++kept;
+            }
+            count -= c.size() - kept;
+            c.truncate(kept);
+            if (c.empty()) chunks.erase(chunks.begin() + static_cast<long>(ci));
+            else ++ci;
+        }
+    }
 
-// Pretty printing
-static void printTasks(const std::vector<Task>& tasks) {
-    if (tasks.empty()) {
-        std::cout << "No tasks found.\n";
-        return;
+    // O(number of chunks): only the shared pointers are copied
+    TaskSnapshot snapshot() const {
+        TaskSnapshot::ChunkList list(resource());
+        list.reserve(chunks.size());
+        for (const auto& c : chunks) list.push_back(c);
+        return TaskSnapshot(std::move(list), count);
     }
-    std::cout << "\n"
-              << std::left << std::setw(6) << "ID"
-              << std::left << std::setw(12) << "Status"
-              << std::left << std::setw(30) << "Title"
-              << "Notes\n";
-    std::cout << std::string(75, '=') << "\n";
-    for (const auto& t : tasks) {
-        std::cout << std::left << std::setw(6) << t.getId()
-                  << std::left << std::setw(12) << (t.isCompleted() ? "Complete" : "Open")
-                  << std::left << std::setw(30) << t.getTitle()
-                  << t.getNotes() << "\n";
+};
+
+// PersistentTaskMap is an immutable hash array mapped trie keyed by task id.
+// Every update returns a new map that shares all untouched nodes with the
+// old one, so keeping many versions costs only the changed paths. Nodes use
+// the compressed layout with separate bitmaps for inline entries and
+// children; ids are their own hash, consumed 5 bits per level.
+class PersistentTaskMap {
+    static constexpr unsigned kBits = 5;
+    static constexpr uint32_t kMask = (1u << kBits) - 1;
+
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+    using TaskPtr = std::shared_ptr<const Task>;
+
+    struct Node {
+        uint32_t dataMap = 0;   // slots holding a task directly
+        uint32_t nodeMap = 0;   // slots holding a child node
+        std::pmr::vector<TaskPtr> data;
+        std::pmr::vector<NodePtr> nodes;
+
+        explicit Node(std::pmr::memory_resource* r) : data(r), nodes(r) {}
+
+        static unsigned index(uint32_t map, uint32_t bit) {
+            return popCount(map & (bit - 1));
+        }
+    };
+
+    std::pmr::memory_resource* res;
+    NodePtr root;
+    size_t count = 0;
+
+    static uint32_t slotOf(int id, unsigned shift) {
+        return (static_cast<uint32_t>(id) >> shift) & kMask;
     }
-    std::cout << "\n";
-}
 
-static void printMenu() {
-    std::cout << "=============================\n";
-    std::cout << "       To Do List Menu       \n";
-    std::cout << "=============================\n";
-    std::cout << "1. List tasks\n";
-    std::cout << "2. Add task\n";
-    std::cout << "3. Toggle complete\n";
+    std::shared_ptr<Node> makeNode() const {
+        return std::allocate_shared<Node>(std::pmr::polymorphic_allocator<Node>(res), res);
+    }
+
+    std::shared_ptr<Node> copyNode(const NodePtr& n) const {
+        auto c = makeNode();
+        if (n) {
+            c->dataMap = n->dataMap;
+            c->nodeMap = n->nodeMap;
+            c->data.assign(n->data.begin(), n->data.end());
+            c->nodes.assign(n->nodes.begin(), n->nodes.end());
+        }
+        return c;
+    }
+
+    // Build the smallest subtree that tells two tasks apart
+    NodePtr pairNode(const TaskPtr& a, const TaskPtr& b, unsigned shift) const {
+        auto n = makeNode();
+        uint32_t sa = slotOf(a->getId(), shift);
+        uint32_t sb = slotOf(b->getId(), shift);
+        if (sa == sb) {
+            n->nodeMap = 1u << sa;
+            n->nodes.push_back(pairNode(a, b, shift + kBits));
+        } else {
+            n->dataMap = (1u << sa) | (1u << sb);
+            if (sa < sb) {
+                n->data.push_back(a);
+                n->data.push_back(b);
+            } else {
+                n->data.push_back(b);
+                n->data.push_back(a);
+            }
+        }
+        return n;
+    }
+
+    NodePtr insert(const NodePtr& n, const TaskPtr& t, unsigned shift, bool& added) const {
+        uint32_t bit = 1u << slotOf(t->getId(), shift);
+        auto c = copyNode(n);
+        if (c->dataMap & bit) {
+            unsigned i = Node::index(c->dataMap, bit);
+            if (c->data[i]->getId() == t->getId()) {
+                c->data[i] = t;
+            } else {
+                // Two ids share this slot: push both one level down
+                NodePtr sub = pairNode(c->data[i], t, shift + kBits);
+                c->data.erase(c->data.begin() + i);
+                c->dataMap &= ~bit;
+                c->nodeMap |= bit;
+                c->nodes.insert(c->nodes.begin() + Node::index(c->nodeMap, bit), sub);
+                added = true;
+            }
+        } else if (c->nodeMap & bit) {
+            unsigned i = Node::index(c->nodeMap, bit);
+            c->nodes[i] = insert(c->nodes[i], t, shift + kBits, added);
+        } else {
+            c->dataMap |= bit;
+            c->data.insert(c->data.begin() + Node::index(c->dataMap, bit), t);
+            added = true;
+        }
+        return c;
+    }
+
+    NodePtr remove(const NodePtr& n, int id, unsigned shift, bool& removed) const {
+        uint32_t bit = 1u << slotOf(id, shift);
+        if (n->dataMap & bit) {
+            unsigned i = Node::index(n->dataMap, bit);
+            if (n->data[i]->getId() != id) return n;
+            removed = true;
+            auto c = copyNode(n);
+            c->data.erase(c->data.begin() + i);
+            c->dataMap &= ~bit;
+            if (c->dataMap == 0 && c->nodeMap == 0) return nullptr;
+            return c;
+        }
+        if (!(n->nodeMap & bit)) return n;
+        unsigned i = Node::index(n->nodeMap, bit);
+        NodePtr sub = remove(n->nodes[i], id, shift + kBits, removed);
+        if (!removed) return n;
+        auto c = copyNode(n);
+        if (sub && !(sub->nodeMap == 0 && sub->data.size() == 1)) {
+            c->nodes[i] = sub;
+            return c;
+        }
+        // Child shrank to a single task (or nothing): pull it up inline
+        c->nodes.erase(c->nodes.begin() + i);
+        c->nodeMap &= ~bit;
+        if (sub) {
+            c->dataMap |= bit;
+            c->data.insert(c->data.begin() + Node::index(c->dataMap, bit), sub->data[0]);
+        }
+        if (c->dataMap == 0 && c->nodeMap == 0) return nullptr;
+        return c;
+    }
+
+    template <typename Fn>
+    static void walk(const NodePtr& n, Fn& fn) {
+        if (!n) return;
+        for (const auto& t : n->data) fn(*t);
+        for (const auto& c : n->nodes) walk(c, fn);
+    }
+
+    PersistentTaskMap(std::pmr::memory_resource* r, NodePtr root_, size_t count_)
+        : res(r), root(std::move(root_)), count(count_) {}
+
+public:
+    explicit PersistentTaskMap(std::pmr::memory_resource* r = std::pmr::get_default_resource())
+        : res(r) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const Task* find(int id) const {
+        const Node* n = root.get();
+        for (unsigned shift = 0; n; shift += kBits) {
+            uint32_t bit = 1u << slotOf(id, shift);
+            if (n->dataMap & bit) {
+                const Task& t = *n->data[Node::index(n->dataMap, bit)];
+                return t.getId() == id ? &t : nullptr;
+            }
+            if (!(n->nodeMap & bit)) return nullptr;
+            n = n->nodes[Node::index(n->nodeMap, bit)].get();
+        }
+        return nullptr;
+    }
+
+    // New version with the task added or replaced
+    PersistentTaskMap set(const Task& t) const {
+        auto leaf = std::allocate_shared<Task>(std::pmr::polymorphic_allocator<Task>(res), t);
+        bool added = false;
+        NodePtr r = insert(root, leaf, 0, added);
+        return PersistentTaskMap(res, std::move(r), count + (added ? 1 : 0));
+    }
+
+    // New version without the task (the same map if it was absent)
+    PersistentTaskMap erase(int id) const {
+        if (!root) return *this;
+        bool removed = false;
+        NodePtr r = remove(root, id, 0, removed);
+        if (!removed) return *this;
+        return PersistentTaskMap(res, std::move(r), count - 1);
+    }
+
+    // Visit every task; the order follows the trie, not the ids
+    template <typename Fn>
+    void forEach(Fn fn) const { walk(root, fn); }
+
+    // Tasks of this version ordered by id, as the list would show them
+    std::vector<const Task*> sorted() const {
+        std::vector<const Task*> out;
+        out.reserve(count);
+        forEach([&](const Task& t) { out.push_back(&t); });
+        std::sort(out.begin(), out.end(),
+                  [](const Task* a, const Task* b) { return a->getId() < b->getId(); });
+        return out;
+    }
+};
+
+// TaskHistory keeps every committed version of the list reachable for
+// time-travel queries. The working map is updated alongside TaskManager's
+// own store; commit() freezes it under a version number, time and tag.
+class TaskHistory {
+public:
+    using Clock = std::chrono::system_clock;
+
+    struct Version {
+        int number;
+        Clock::time_point committedAt;
+        std::string tag;
+        PersistentTaskMap tasks;
+    };
+
+private:
+    std::pmr::memory_resource* res;
+    PersistentTaskMap working;
+    std::vector<Version> versions;
+
+public:
+    explicit TaskHistory(std::pmr::memory_resource* r) : res(r), working(r) {}
+
+    void put(const Task& t) { working = working.set(t); }
+    void remove(int id) { working = working.erase(id); }
+    void clear() { working = PersistentTaskMap(res); }
+
+    const PersistentTaskMap& current() const { return working; }
+    const std::vector<Version>& all() const { return versions; }
+
+    int commit(const std::string& tag = "") {
+        int number = versions.empty() ? 1 : versions.back().number + 1;
+        versions.push_back(Version{number, Clock::now(), tag, working});
+        return number;
+    }
+
+    const Version* byNumber(int number) const {
+        for (const auto& v : versions) {
+            if (v.number == number) return &v;
+        }
+        return nullptr;
+    }
+
+    const Version* byTag(const std::string& tag) const {
+        for (auto it = versions.rbegin(); it != versions.rend(); ++it) {
+            if (it->tag == tag) return &*it;
+        }
+        return nullptr;
+    }
+
+    // Latest version committed at or before the given time
+    const Version* asOf(Clock::time_point when) const {
+        auto it = std::upper_bound(versions.begin(), versions.end(), when,
+                                   [](Clock::time_point w, const Version& v) { return w < v.committedAt; });
+        return it == versions.begin() ? nullptr : &*(it - 1);
+    }
+};
+
+// Flush a stdio stream all the way to the device
+static bool syncFile(std::FILE* f) {
+    if (std::fflush(f) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
+
+// Make a rename into the directory holding path durable. Windows has no
+// directory handle to flush and commits renames with the metadata.
+static bool syncParentDir(const std::string& path) {
+#ifdef _WIN32
+    (void)path;
+    return true;
+#else
+    std::filesystem::path dir = std::filesystem::path(path).parent_path();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    return ::close(fd) == 0 && ok;
+#endif
+}
+
+// TaskOp is one logged change. Ops are absolute (set completion instead of
+// flipping it, upsert instead of insert), so replaying a journal over a
+// snapshot that already holds some of its changes gives the same result.
+struct TaskOp {
+    enum class Kind : char {
+        Add = 'A',
+        Edit = 'E',
+        SetCompleted = 'S',
+        Toggle = 'T',   // only before commit; logged as SetCompleted
+        Remove = 'R',
+        Clear = 'C'
+    };
+
+    Kind kind = Kind::Clear;
+    int id = 0;
+    bool completed = false;
+    uint64_t expectedVersion = 0;  // only apply if the task is at this version (0: any)
+    // The task's own string types, so an add can hand them over whole
+    TitleString title;
+    std::pmr::string notes;
+
+    TaskOp() = default;
+    explicit TaskOp(std::pmr::memory_resource* res) : title(Task::allocator_type(res)), notes(res) {}
+
+    // Strings are drawn from res; pass the task store's to let an add
+    // move them into the task
+    static TaskOp make(Kind k, int id_, std::string_view title_ = {}, std::string_view notes_ = {},
+                       uint64_t expected = 0, std::pmr::memory_resource* res = std::pmr::get_default_resource()) {
+        TaskOp op(res);
+        op.kind = k;
+        op.id = id_;
+        op.expectedVersion = expected;
+        op.title = title_;
+        op.notes = notes_;
+        return op;
+    }
+};
+
+// TaskJournal is an append-only log of committed transactions next to the
+// task file. Each commit is written as one record framed by a begin line
+// and a commit line, then synced once, so a crash leaves at most a torn
+// record at the tail, which replay ignores. Text fields use the quoted
+// dialect, flagged by a trailing ",q" on the begin line; records from
+// before that use the escaped one.
+class TaskJournal {
+    std::string path;
+    std::FILE* file = nullptr;
+    size_t records = 0;  // commit records since the last truncate
+
+    static void encode(const TaskOp& op, std::string& out) {
+        out += static_cast<char>(op.kind);
+        switch (op.kind) {
+        case TaskOp::Kind::Add:
+            out += "," + std::to_string(op.id) + "," + (op.completed ? "1" : "0") + ","
+                 + Task::quoteField(op.title) + "," + Task::quoteField(op.notes);
+            break;
+        case TaskOp::Kind::Edit:
+            out += "," + std::to_string(op.id) + ","
+                 + Task::quoteField(op.title) + "," + Task::quoteField(op.notes);
+            break;
+        case TaskOp::Kind::SetCompleted:
+            out += "," + std::to_string(op.id) + "," + (op.completed ? "1" : "0");
+            break;
+        case TaskOp::Kind::Toggle:
+        case TaskOp::Kind::Remove:
+            out += "," + std::to_string(op.id);
+            break;
+        case TaskOp::Kind::Clear:
+            break;
+        }
+        out += '\n';
+    }
+
+    static bool decode(std::string_view line, TaskOp& op, CsvDialect dialect) {
+        if (line.empty()) return false;
+        op = TaskOp();
+        op.kind = static_cast<TaskOp::Kind>(line[0]);
+        std::string_view rest = line.size() > 2 ? line.substr(2) : std::string_view();
+        std::string_view f[4];
+        std::string scratch;
+        int flag = 0;
+        auto split = [&](size_t n) {
+            return dialect == CsvDialect::Rfc4180 ? Task::splitQuoted(rest, f, n) : Task::splitFields(rest, f, n);
+        };
+        switch (op.kind) {
+        case TaskOp::Kind::Add:
+            if (!split(4) || !parseInt(f[0], op.id) || !parseInt(f[1], flag)) return false;
+            op.completed = flag != 0;
+            op.title = Task::decodeField(f[2], scratch, dialect);
+            op.notes = Task::decodeField(f[3], scratch, dialect);
+            return true;
+        case TaskOp::Kind::Edit:
+            if (!split(3) || !parseInt(f[0], op.id)) return false;
+            op.title = Task::decodeField(f[1], scratch, dialect);
+            op.notes = Task::decodeField(f[2], scratch, dialect);
+            return true;
+        case TaskOp::Kind::SetCompleted:
+            if (!Task::splitFields(rest, f, 2) || !parseInt(f[0], op.id) || !parseInt(f[1], flag)) return false;
+            op.completed = flag != 0;
+            return true;
+        case TaskOp::Kind::Remove:
+            return parseInt(rest, op.id);
+        case TaskOp::Kind::Clear:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+public:
+    explicit TaskJournal(std::string filePath) : path(std::move(filePath)) {}
+    ~TaskJournal() {
+        if (file) std::fclose(file);
+    }
+
+    TaskJournal(const TaskJournal&) = delete;
+    TaskJournal& operator=(const TaskJournal&) = delete;
+
+    const std::string& filePath() const { return path; }
+
+    // Append one commit record and make it durable with a single sync
+    bool append(const std::vector<TaskOp>& ops) {
+        if (!file) file = std::fopen(path.c_str(), "ab");
+        if (!file) return false;
+        std::string record = "B," + std::to_string(ops.size()) + ",q\n";
+        for (const auto& op : ops) encode(op, record);
+        record += "K," + std::to_string(ops.size()) + "\n";
+        if (std::fwrite(record.data(), 1, record.size(), file) != record.size()) return false;
+        if (!syncFile(file)) return false;
+        ++records;
+        return true;
+    }
+
+    size_t recordCount() const { return records; }
+    void setRecordCount(size_t n) { records = n; }
+
+    // Drop all records, once a saved snapshot covers them
+    bool truncate() {
+        if (file) {
+            std::fclose(file);
+            file = nullptr;
+        }
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) return false;
+        std::fclose(f);
+        records = 0;
+        return true;
+    }
+
+    // Hand every complete record to apply, oldest first. Returns how many
+    // records were replayed; a torn or malformed record is skipped.
+    template <typename Fn>
+    static size_t replay(const std::string& path, Fn apply) {
+        std::ifstream in(path);
+        if (!in.is_open()) return 0;
+        std::vector<TaskOp> pending;
+        bool inRecord = false;
+        int expected = 0;
+        CsvDialect dialect = CsvDialect::Escaped;
+        size_t done = 0;
+        std::string line;
+        std::string more;
+        while (std::getline(in, line)) {
+            if (line.rfind("B,", 0) == 0) {
+                pending.clear();
+                inRecord = parseInt(std::string_view(line).substr(2), expected);
+                bool quoted = line.size() > 2 && line.compare(line.size() - 2, 2, ",q") == 0;
+                dialect = quoted ? CsvDialect::Rfc4180 : CsvDialect::Escaped;
+            } else if (line.rfind("K,", 0) == 0) {
+                if (inRecord && pending.size() == static_cast<size_t>(expected)) {
+                    apply(pending);
+                    ++done;
+                }
+                inRecord = false;
+            } else if (inRecord) {
+                // Quoted text can span lines
+                while (dialect == CsvDialect::Rfc4180 && !Task::quotesBalanced(line) && std::getline(in, more)) {
+                    line += '\n';
+                    line += more;
+                }
+                TaskOp op;
+                if (decode(line, op, dialect)) pending.push_back(std::move(op));
+                else inRecord = false;
+            }
+        }
+        return done;
+    }
+};
+
+// Net effect of a run of journal ops on one task id. A Patch only touches
+// the fields it carries and only if the task exists by then; an Upsert is
+// a whole record. Ops on different ids commute, so each id's run can be
+// folded on its own and the results combined in any order.
+struct NetChange {
+    enum class Kind { Patch, Upsert, Remove };
+
+    Kind kind = Kind::Patch;
+    std::optional<TitleString> title;
+    std::optional<std::pmr::string> notes;
+    std::optional<bool> completed;
+
+    void fold(TaskOp& op) {
+        switch (op.kind) {
+        case TaskOp::Kind::Add:
+            kind = Kind::Upsert;
+            title = std::move(op.title);
+            notes = std::move(op.notes);
+            completed = op.completed;
+            break;
+        case TaskOp::Kind::Edit:
+            if (kind == Kind::Remove) break;
+            if (!op.title.empty()) title = std::move(op.title);
+            if (!op.notes.empty()) notes = std::move(op.notes);
+            break;
+        case TaskOp::Kind::SetCompleted:
+            if (kind != Kind::Remove) completed = op.completed;
+            break;
+        case TaskOp::Kind::Remove:
+            kind = Kind::Remove;
+            title.reset();
+            notes.reset();
+            completed.reset();
+            break;
+        case TaskOp::Kind::Toggle:
+        case TaskOp::Kind::Clear:
+            // Never logged per id: toggles are resolved before logging and
+            // clears are handled by the caller as a barrier
+            break;
+        }
+    }
+};
+
+// JournalReplayer rebuilds state from a journal in parallel. Everything
+// before the last Clear is dead, so only the tail after it is replayed.
+// That tail is partitioned by task id across worker threads, each folding
+// its ids' ops in log order into a NetChange; the caller then applies the
+// per-id results to the snapshot in one pass.
+class JournalReplayer {
+public:
+    struct Result {
+        bool cleared = false;  // a Clear was replayed: start from empty
+        size_t records = 0;
+        size_t ops = 0;
+        std::vector<std::unordered_map<int, NetChange>> partitions;
+
+        NetChange* find(int id) {
+            if (partitions.empty()) return nullptr;
+            auto& part = partitions[partitionOf(id, partitions.size())];
+            auto it = part.find(id);
+            return it == part.end() ? nullptr : &it->second;
+        }
+    };
+
+    static size_t partitionOf(int id, size_t parts) {
+        return static_cast<size_t>(static_cast<uint32_t>(id) * 2654435761u) % parts;
+    }
+
+    static Result run(const std::string& path, unsigned threads = std::thread::hardware_concurrency()) {
+        Result result;
+        std::vector<TaskOp> ops;
+        result.records = TaskJournal::replay(path, [&](std::vector<TaskOp>& record) {
+            for (auto& op : record) ops.push_back(std::move(op));
+        });
+        result.ops = ops.size();
+
+        size_t start = 0;
+        for (size_t i = ops.size(); i > 0; --i) {
+            if (ops[i - 1].kind == TaskOp::Kind::Clear) {
+                result.cleared = true;
+                start = i;
+                break;
+            }
+        }
+
+        // Small logs are not worth the threads
+        size_t live = ops.size() - start;
+        size_t parts = std::max<size_t>(1, std::min<size_t>(threads ? threads : 1, live / 4096 + 1));
+        std::vector<std::vector<TaskOp*>> byPart(parts);
+        for (size_t i = start; i < ops.size(); ++i) {
+            byPart[partitionOf(ops[i].id, parts)].push_back(&ops[i]);
+        }
+
+        result.partitions.resize(parts);
+        auto foldPart = [&](size_t p) {
+            auto& out = result.partitions[p];
+            for (TaskOp* op : byPart[p]) out[op->id].fold(*op);
+        };
+        std::vector<std::thread> workers;
+        for (size_t p = 1; p < parts; ++p) workers.emplace_back(foldPart, p);
+        foldPart(0);
+        for (auto& w : workers) w.join();
+        return result;
+    }
+};
+
+// 64-bit FNV-1a, used to fingerprint snapshot contents
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+
+static uint64_t fnv1a(uint64_t h, std::string_view bytes) {
+    for (unsigned char c : bytes) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Call fn with each lower-cased alphanumeric word of text
+template <typename Fn>
+static void forEachWord(std::string_view text, Fn fn) {
+    std::string word;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (std::isalnum(c)) {
+            word.push_back(static_cast<char>(std::tolower(c)));
+        } else if (!word.empty()) {
+            fn(std::string_view(word));
+            word.clear();
+        }
+    }
+}
+
+// MappedFile is a read-only byte range: a memory-mapped file where the
+// platform supports it, otherwise (or for freshly built data) an owned
+// buffer.
+class MappedFile {
+    const char* bytes = nullptr;
+    size_t length = 0;
+    std::pmr::vector<char> owned;
+    bool mapped = false;
+
+public:
+    explicit MappedFile(std::pmr::vector<char>&& buffer) : owned(std::move(buffer)) {
+        bytes = owned.data();
+        length = owned.size();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapped) munmap(const_cast<char*>(bytes), length);
+#endif
+    }
+
+    static std::unique_ptr<MappedFile> open(const std::string& path, std::pmr::memory_resource* res) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return nullptr;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return nullptr;
+        auto file = std::unique_ptr<MappedFile>(new MappedFile(std::pmr::vector<char>(res)));
+        file->bytes = static_cast<const char*>(p);
+        file->length = size;
+        file->mapped = true;
+        return file;
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return nullptr;
+        std::pmr::vector<char> buffer{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>(), res};
+        return std::make_unique<MappedFile>(std::move(buffer));
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// BlobStore keeps large notes out of the task file, in an append-only file
+// beside it (tasks.csv.blobs.<generation>). Each blob is an 8-byte header
+// ("blob" and the length) followed by the bytes. The task file holds only a
+// marker naming the generation, offset and length, so loads, scans and
+// saves skip the text. Reads map the file, so a blob is paged in only when
+// its notes are looked at; older mappings are kept, so views handed out
+// stay valid after the file grows.
+class BlobStore {
+public:
+    struct Ref {
+        uint32_t generation = 0;
+        uint64_t offset = 0;  // of the bytes, just past the header
+        uint32_t length = 0;
+    };
+
+    // Notes at least this long are moved out of line on save
+    static constexpr size_t kThreshold = 1024;
+    static constexpr std::string_view kPrefix = "@blob:";
+    static constexpr size_t kHeaderSize = 8;
+
+private:
+    std::string path;
+    uint32_t gen;
+    mutable std::mutex mutex;
+    mutable std::vector<std::unique_ptr<MappedFile>> maps;
+    mutable std::FILE* out = nullptr;
+    uint64_t fileSize = 0;
+
+    // Map enough of the file to cover end, flushing pending appends first
+    const MappedFile* mapped(uint64_t end) const {
+        if (!maps.empty() && maps.back()->size() >= end) return maps.back().get();
+        if (out) std::fflush(out);
+        auto file = MappedFile::open(path, std::pmr::get_default_resource());
+        if (!file || file->size() < end) return nullptr;
+        maps.push_back(std::move(file));
+        return maps.back().get();
+    }
+
+public:
+    // Open a generation; fresh truncates any file left from an earlier try
+    BlobStore(std::string filePath, uint32_t generation, bool fresh = false)
+        : path(std::move(filePath)), gen(generation) {
+        if (fresh) {
+            out = std::fopen(path.c_str(), "wb");
+        } else {
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (in.is_open()) fileSize = static_cast<uint64_t>(in.tellg());
+        }
+    }
+
+    ~BlobStore() {
+        if (out) std::fclose(out);
+    }
+
+    BlobStore(const BlobStore&) = delete;
+    BlobStore& operator=(const BlobStore&) = delete;
+
+    static std::string pathFor(const std::string& tasksPath, uint32_t generation) {
+        return tasksPath + ".blobs." + std::to_string(generation);
+    }
+
+    static std::string marker(const Ref& r) {
+        return std::string(kPrefix) + std::to_string(r.generation) + ":" + std::to_string(r.offset) + ":"
+             + std::to_string(r.length);
+    }
+
+    static bool parseMarker(std::string_view s, Ref& r) {
+        if (s.substr(0, kPrefix.size()) != kPrefix) return false;
+        s.remove_prefix(kPrefix.size());
+        const char* p = s.data();
+        const char* end = s.data() + s.size();
+        auto field = [&](auto& value, bool last) {
+            auto res = std::from_chars(p, end, value);
+            if (res.ec != std::errc() || (last ? res.ptr != end : res.ptr == end || *res.ptr != ':')) return false;
+            p = res.ptr + 1;
+            return true;
+        };
+        return field(r.generation, false) && field(r.offset, false) && field(r.length, true);
+    }
+
+    uint32_t generation() const { return gen; }
+    const std::string& filePath() const { return path; }
+    uint64_t size() const { return fileSize; }
+
+    std::optional<Ref> append(std::string_view bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!out) out = std::fopen(path.c_str(), "ab");
+        if (!out || bytes.size() > UINT32_MAX) return std::nullopt;
+        char header[kHeaderSize] = {'b', 'l', 'o', 'b'};
+        uint32_t length = static_cast<uint32_t>(bytes.size());
+        std::memcpy(header + 4, &length, sizeof length);
+        if (std::fwrite(header, 1, sizeof header, out) != sizeof header
+            || std::fwrite(bytes.data(), 1, bytes.size(), out) != bytes.size()) {
+            return std::nullopt;
+        }
+        Ref r{gen, fileSize + kHeaderSize, length};
+        fileSize += kHeaderSize + length;
+        return r;
+    }
+
+    // Make appended blobs durable
+    bool sync() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !out || syncFile(out);
+    }
+
+    // The blob's bytes; false if the file does not hold it
+    bool fetch(const Ref& r, std::string_view& bytes) const {
+        if (r.generation != gen || r.offset < kHeaderSize) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        const MappedFile* file = mapped(r.offset + r.length);
+        if (!file) return false;
+        const char* header = file->data() + r.offset - kHeaderSize;
+        uint32_t length = 0;
+        std::memcpy(&length, header + 4, sizeof length);
+        if (std::memcmp(header, "blob", 4) != 0 || length != r.length) return false;
+        bytes = std::string_view(file->data() + r.offset, r.length);
+        return true;
+    }
+
+    // Map the whole file now, so blobs stay readable once it is deleted
+    void pin() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        mapped(fileSize);
+    }
+};
+
+inline bool Task::readNotes(std::string_view& text) const {
+    text = notes;
+    if (!blobs) return true;
+    BlobStore::Ref r;
+    return BlobStore::parseMarker(notes, r) && blobs->fetch(r, text);
+}
+
+inline std::string_view Task::getNotes() const {
+    std::string_view text;
+    // Inline notes, or a blob that cannot be read: show the marker
+    return readNotes(text) ? text : std::string_view(notes);
+}
+
+// BlobFiles is the set of blob stores one task file refers to, by
+// generation. New blobs go to the newest one.
+class BlobFiles {
+    std::string tasksPath;
+    std::map<uint32_t, std::shared_ptr<BlobStore>> stores;
+
+public:
+    explicit BlobFiles(std::string path) : tasksPath(std::move(path)) {}
+
+    std::shared_ptr<BlobStore> store(uint32_t generation) {
+        auto& s = stores[generation];
+        if (!s) s = std::make_shared<BlobStore>(BlobStore::pathFor(tasksPath, generation), generation);
+        return s;
+    }
+
+    std::shared_ptr<BlobStore> current() { return store(stores.empty() ? 1 : stores.rbegin()->first); }
+
+    // Start a new generation with an empty file, for compaction
+    std::shared_ptr<BlobStore> next() {
+        uint32_t generation = stores.empty() ? 1 : stores.rbegin()->first + 1;
+        auto s = std::make_shared<BlobStore>(BlobStore::pathFor(tasksPath, generation), generation, true);
+        stores[generation] = s;
+        return s;
+    }
+
+    // Point a freshly read task at its blob if its notes are a marker
+    void attach(Task& t) {
+        BlobStore::Ref r;
+        if (BlobStore::parseMarker(t.storedNotes(), r)) t.setNotesRef(store(r.generation), t.storedNotes());
+    }
+
+    size_t count() const { return stores.size(); }
+
+    uint64_t totalBytes() const {
+        uint64_t bytes = 0;
+        for (const auto& s : stores) bytes += s.second->size();
+        return bytes;
+    }
+
+    // Delete every generation but the newest. Tasks elsewhere (snapshots,
+    // history) may still refer to them, so their files are mapped first.
+    void dropOld() {
+        while (stores.size() > 1) {
+            auto oldest = stores.begin();
+            oldest->second->pin();
+            std::remove(oldest->second->filePath().c_str());
+            stores.erase(oldest);
+        }
+    }
+
+    void clear() { stores.clear(); }
+};
+
+// EliasFano codes a sorted list of n ids no larger than m in about
+// 2 + log2(m / n) bits each. The low l bits of every id are packed side by
+// side; the rest (the id's bucket) is unary coded in a high bit array as one
+// 1 per id and one 0 closing each bucket. Lists are appended to a shared
+// arena of 64-bit words at any bit offset, so short lists cost no padding.
+// A sample every kSample buckets lets a cursor jump straight to the bucket
+// of a target, which makes successor (seek) and rank queries cheap.
+class EliasFano {
+public:
+    static constexpr uint32_t kSample = 256;
+
+    // Where a list lives in the arena and how it is coded
+    struct List {
+        uint64_t at = 0;  // bit offset in the arena
+        uint32_t count = 0;
+        uint32_t buckets = 0;
+        uint8_t lowBits = 0;
+
+        uint64_t highAt() const { return at + uint64_t(count) * lowBits; }
+        uint64_t highLength() const { return uint64_t(count) + buckets; }
+        uint64_t samplesAt() const { return highAt() + highLength(); }
+        uint32_t sampleCount() const { return buckets ? (buckets - 1) / kSample : 0; }
+    };
+
+    // Appends bits to an arena, keeping a spare zero word at the end so
+    // readers may always load the word after the one they need
+    class Writer {
+        std::pmr::vector<uint64_t>& words;
+        uint64_t length;
+
+    public:
+        Writer(std::pmr::vector<uint64_t>& arena, uint64_t bitLength) : words(arena), length(bitLength) {
+            words.resize(length / 64 + 2, 0);
+        }
+
+        uint64_t position() const { return length; }
+
+        void put(uint64_t value, unsigned width) {
+            if (width == 0) return;
+            if (width < 64) value &= (uint64_t(1) << width) - 1;
+            uint64_t w = length / 64;
+            unsigned off = static_cast<unsigned>(length % 64);
+            if (words.size() < (length + width) / 64 + 2) words.resize((length + width) / 64 + 2, 0);
+            words[w] |= value << off;
+            if (off && off + width > 64) words[w + 1] |= value >> (64 - off);
+            length += width;
+        }
+
+        void zeros(uint64_t n) {
+            length += n;
+            words.resize(length / 64 + 2, 0);
+        }
+    };
+
+    // Code ids (sorted ascending) at the writer's position
+    static List append(Writer& out, const uint32_t* ids, size_t n) {
+        List list;
+        list.at = out.position();
+        list.count = static_cast<uint32_t>(n);
+        if (n == 0) return list;
+        uint32_t top = ids[n - 1];
+        list.lowBits = top / n ? static_cast<uint8_t>(highestBit(top / n)) : 0;
+        list.buckets = (top >> list.lowBits) + 1;
+        for (size_t i = 0; i < n; ++i) out.put(ids[i], list.lowBits);
+        uint32_t bucket = 0;
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t b = ids[i] >> list.lowBits;
+            out.zeros(b - bucket);
+            out.put(1, 1);
+            bucket = b;
+        }
+        out.zeros(1);
+        // Sample k holds the high-array position where bucket k * kSample starts
+        size_t j = 0;
+        for (uint32_t k = 1; k <= list.sampleCount(); ++k) {
+            uint32_t b = k * kSample;
+            while (j < n && (ids[j] >> list.lowBits) < b) ++j;
+            out.put(b + j, 32);
+        }
+        return list;
+    }
+
+    static uint64_t bits(const uint64_t* arena, uint64_t pos, unsigned width) {
+        uint64_t w = pos / 64;
+        unsigned off = static_cast<unsigned>(pos % 64);
+        uint64_t v = arena[w] >> off;
+        if (off && off + width > 64) v |= arena[w + 1] << (64 - off);
+        return width == 64 ? v : v & ((uint64_t(1) << width) - 1);
+    }
+
+    // Walks a list in order. seek() moves forward to the first id not
+    // below a target, jumping whole buckets through the samples.
+    class Cursor {
+        const uint64_t* arena;
+        List list;
+        uint32_t index = 0;  // of the current id
+        uint64_t pos = 0;    // of its 1 in the high array
+        uint32_t current = 0;
+
+        // First 1 at or after p in the high array, or the array's length
+        uint64_t nextOne(uint64_t p) const {
+            const uint64_t end = list.highLength();
+            while (p < end) {
+                unsigned width = static_cast<unsigned>(std::min<uint64_t>(64, end - p));
+                uint64_t w = bits(arena, list.highAt() + p, width);
+                if (w) return p + countTrailingZeros(w);
+                p += width;
+            }
+            return end;
+        }
+
+        // Position just past the z-th 0 from p (z >= 1)
+        uint64_t skipZeros(uint64_t p, uint64_t z) const {
+            const uint64_t end = list.highLength();
+            while (p < end) {
+                unsigned width = static_cast<unsigned>(std::min<uint64_t>(64, end - p));
+                uint64_t w = ~bits(arena, list.highAt() + p, width);
+                if (width < 64) w &= (uint64_t(1) << width) - 1;
+                uint64_t c = popCount(w);
+                if (c >= z) {
+                    for (; z > 1; --z) w &= w - 1;
+                    return p + countTrailingZeros(w) + 1;
+                }
+                z -= c;
+                p += width;
+            }
+            return end;
+        }
+
+        void settle() {
+            if (index >= list.count) return;
+            uint64_t bucket = pos - index;
+            uint64_t low = bits(arena, list.at + uint64_t(index) * list.lowBits, list.lowBits);
+            current = static_cast<uint32_t>((bucket << list.lowBits) | low);
+        }
+
+    public:
+        Cursor(const uint64_t* a, const List& l) : arena(a), list(l) {
+            if (list.count) pos = nextOne(0);
+            settle();
+        }
+
+        bool valid() const { return index < list.count; }
+        uint32_t value() const { return current; }
+        // Ids before the current one, or the list size once past the end
+        uint32_t rank() const { return std::min(index, list.count); }
+
+        void next() {
+            if (++index < list.count) pos = nextOne(pos + 1);
+            settle();
+        }
+
+        void seek(uint32_t target) {
+            if (!valid() || current >= target) return;
+            uint64_t bucket = uint64_t(target) >> list.lowBits;
+            if (bucket >= list.buckets) {
+                index = list.count;
+                return;
+            }
+            if (bucket > pos - index) {
+                uint64_t k = bucket / kSample;
+                uint64_t start = k ? bits(arena, list.samplesAt() + (k - 1) * 32, 32) : 0;
+                uint64_t skip = bucket - k * kSample;
+                if (skip) start = skipZeros(start, skip);
+                // Ones before the bucket = its start minus the zeros before it
+                index = static_cast<uint32_t>(start - bucket);
+                pos = nextOne(start);
+                settle();
+            }
+            while (valid() && current < target) next();
+        }
+    };
+
+    // Ids in the list below x
+    static uint32_t rank(const uint64_t* arena, const List& list, uint32_t x) {
+        Cursor c(arena, list);
+        c.seek(x);
+        return c.rank();
+    }
+
+    template <typename Fn>
+    static void forEach(const uint64_t* arena, const List& list, Fn fn) {
+        for (Cursor c(arena, list); c.valid(); c.next()) fn(c.value());
+    }
+};
+
+// Delta + varint coding of sorted id lists, the usual compact alternative
+// that `todo bench postings` weighs Elias-Fano against: each gap from the
+// previous id (the first from 0) in 7-bit groups, low group first, with the
+// top bit set on every byte but the last
+static void putVarint(std::string& out, uint32_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+static bool getVarint(const char*& p, const char* end, uint32_t& v) {
+    v = 0;
+    for (unsigned shift = 0; p < end && shift < 35; shift += 7) {
+        uint32_t byte = static_cast<unsigned char>(*p++);
+        v |= (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// TitleIndex is an inverted index from title words to task ids. Each
+// word's ids are an Elias-Fano list (see EliasFano) in one shared arena,
+// a few bits per id instead of 32, and multi-word searches intersect the
+// lists by seeking. The saved file holds the same structures as memory:
+//
+//   Header | Term[termCount] (sorted by word) | arena words | word bytes
+//
+// so open() maps it, checks that every term's word and list lie inside
+// the file, and then searches the mapped bytes as they are; no posting
+// is decoded until a query reads it. The header carries the generation of
+// the snapshot it was built from; a file whose generation does not match
+// the loaded tasks is ignored.
+class TitleIndex {
+public:
+    struct Header {
+        char magic[8];
+        uint32_t byteOrder;
+        uint32_t termCount;
+        uint64_t generation;
+        uint64_t postingCount;
+        uint64_t arenaWords;
+        uint64_t poolSize;
+    };
+
+    // One word and its list, in memory and on disk alike
+    struct Term {
+        uint32_t wordOffset;
+        uint32_t wordLength;
+        uint64_t at;  // the EliasFano::List fields
+        uint32_t count;
+        uint32_t buckets;
+        uint32_t lowBits;
+        uint32_t unused;
+
+        EliasFano::List ids() const {
+            EliasFano::List list;
+            list.at = at;
+            list.count = count;
+            list.buckets = buckets;
+            list.lowBits = static_cast<uint8_t>(lowBits);
+            return list;
+        }
+    };
+    static_assert(sizeof(Header) % 8 == 0 && sizeof(Term) % 8 == 0, "the arena must stay word aligned in files");
+
+private:
+    static constexpr char kMagic[8] = {'T', 'D', 'O', 'I', 'D', 'X', '0', '3'};
+    static constexpr uint32_t kByteOrder = 0x01020304;
+
+    uint64_t gen = 0;
+    uint64_t postingCount = 0;
+    // A built index owns its parts; an opened one points into the file,
+    // or into words when the file could only be read to an unaligned buffer
+    std::pmr::string ownPool;
+    std::pmr::vector<Term> ownTerms;
+    std::pmr::vector<uint64_t> words;
+    std::unique_ptr<MappedFile> file;
+    std::string_view pool;
+    const Term* terms = nullptr;
+    size_t termTotal = 0;
+    const uint64_t* arena = nullptr;
+    size_t arenaWords = 0;
+
+    explicit TitleIndex(std::pmr::memory_resource* res) : ownPool(res), ownTerms(res), words(res) {}
+    TitleIndex(const TitleIndex&) = delete;
+    TitleIndex& operator=(const TitleIndex&) = delete;
+
+    std::string_view word(const Term& t) const { return pool.substr(t.wordOffset, t.wordLength); }
+
+    const Term* find(std::string_view w) const {
+        const Term* last = terms + termTotal;
+        const Term* it = std::lower_bound(terms, last, w, [this](const Term& t, std::string_view key) {
+            return word(t) < key;
+        });
+        return it == last || word(*it) != w ? nullptr : it;
+    }
+
+    // Check the layout fits the bytes before trusting any offset: words
+    // inside the pool and in order, lists inside the arena with the spare
+    // word cursors may load past them
+    bool attach(const char* base, size_t size) {
+        if (size < sizeof(Header)) return false;
+        Header h;
+        std::memcpy(&h, base, sizeof h);
+        if (std::memcmp(h.magic, kMagic, sizeof kMagic) != 0 || h.byteOrder != kByteOrder) return false;
+        if (h.arenaWords > size / 8 || h.poolSize > size) return false;
+        uint64_t need = sizeof(Header) + uint64_t(h.termCount) * sizeof(Term) + h.arenaWords * 8 + h.poolSize;
+        if (need != size) return false;
+        terms = reinterpret_cast<const Term*>(base + sizeof(Header));
+        termTotal = h.termCount;
+        arena = reinterpret_cast<const uint64_t*>(base + sizeof(Header) + termTotal * sizeof(Term));
+        arenaWords = h.arenaWords;
+        pool = std::string_view(reinterpret_cast<const char*>(arena + arenaWords), h.poolSize);
+        gen = h.generation;
+        postingCount = h.postingCount;
+        uint64_t total = 0;
+        for (size_t i = 0; i < termTotal; ++i) {
+            const Term& t = terms[i];
+            if (uint64_t(t.wordOffset) + t.wordLength > h.poolSize || (i && word(terms[i - 1]) >= word(t))) {
+                return false;
+            }
+            bool fits = t.lowBits < 32 && t.buckets && (uint64_t(t.buckets - 1) << t.lowBits) <= UINT32_MAX;
+            if (t.count && !fits) return false;
+            EliasFano::List list = t.ids();
+            if (list.samplesAt() + uint64_t(list.sampleCount()) * 32 + 64 > arenaWords * 64) return false;
+            total += t.count;
+        }
+        return total == postingCount;
+    }
+
+public:
+    static std::shared_ptr<const TitleIndex> build(const TaskSnapshot& snap, uint64_t generation,
+                                                   std::pmr::memory_resource* res,
+                                                   std::atomic<size_t>* progress = nullptr) {
+        std::map<std::string, std::vector<uint32_t>, std::less<>> byWord;
+        for (const auto& t : snap) {
+            forEachWord(t.getTitle(), [&](std::string_view w) {
+                auto it = byWord.find(w);
+                if (it == byWord.end()) it = byWord.emplace(std::string(w), std::vector<uint32_t>()).first;
+                it->second.push_back(static_cast<uint32_t>(t.getId()));
+            });
+            if (progress) progress->fetch_add(1, std::memory_order_relaxed);
+        }
+
+        auto index = std::shared_ptr<TitleIndex>(new TitleIndex(res));
+        index->gen = generation;
+        index->ownTerms.reserve(byWord.size());
+        EliasFano::Writer out(index->words, 0);
+        for (auto& [w, ids] : byWord) {
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            EliasFano::List list = EliasFano::append(out, ids.data(), ids.size());
+            index->ownTerms.push_back({static_cast<uint32_t>(index->ownPool.size()), static_cast<uint32_t>(w.size()),
+                                       list.at, list.count, list.buckets, list.lowBits, 0});
+            index->ownPool += w;
+            index->postingCount += ids.size();
+        }
+        index->words.shrink_to_fit();
+        index->pool = index->ownPool;
+        index->terms = index->ownTerms.data();
+        index->termTotal = index->ownTerms.size();
+        index->arena = index->words.data();
+        index->arenaWords = index->words.size();
+        return index;
+    }
+
+    // Load a saved index; null if missing, malformed or for another snapshot
+    static std::shared_ptr<const TitleIndex> open(const std::string& path, uint64_t generation,
+                                                  std::pmr::memory_resource* res) {
+        auto f = MappedFile::open(path, res);
+        if (!f) return nullptr;
+        auto index = std::shared_ptr<TitleIndex>(new TitleIndex(res));
+        const char* base = f->data();
+        size_t size = f->size();
+        if (reinterpret_cast<uintptr_t>(base) % alignof(uint64_t) != 0) {
+            index->words.resize(size / 8 + 1);
+            std::memcpy(index->words.data(), base, size);
+            base = reinterpret_cast<const char*>(index->words.data());
+        } else {
+            index->file = std::move(f);
+        }
+        if (!index->attach(base, size) || index->gen != generation) return nullptr;
+        return index;
+    }
+
+    // Save under the generation of the snapshot it now describes
+    bool write(const std::string& path, uint64_t snapshotGeneration) const {
+        Header h{};
+        std::memcpy(h.magic, kMagic, sizeof kMagic);
+        h.byteOrder = kByteOrder;
+        h.termCount = static_cast<uint32_t>(termTotal);
+        h.generation = snapshotGeneration;
+        h.postingCount = postingCount;
+        h.arenaWords = arenaWords;
+        h.poolSize = pool.size();
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out.is_open()) return false;
+            out.write(reinterpret_cast<const char*>(&h), sizeof h);
+            out.write(reinterpret_cast<const char*>(terms), static_cast<std::streamsize>(termTotal * sizeof(Term)));
+            out.write(reinterpret_cast<const char*>(arena), static_cast<std::streamsize>(arenaWords * 8));
+            out.write(pool.data(), static_cast<std::streamsize>(pool.size()));
+            out.close();
+            if (!out) return false;
+        }
+        std::remove(path.c_str());
+        return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    uint64_t generation() const { return gen; }
+    size_t termCount() const { return termTotal; }
+    size_t postings() const { return postingCount; }
+    size_t postingBytes() const { return arenaWords * sizeof(uint64_t); }
+    // Bytes of the index, owned or mapped, against postings() * 4 for
+    // plain id arrays
+    size_t byteSize() const { return pool.size() + termTotal * sizeof(Term) + postingBytes(); }
+
+    // Number of tasks below id whose title contains the word (lower-case)
+    size_t rank(std::string_view w, uint32_t id) const {
+        const Term* t = find(w);
+        return t ? EliasFano::rank(arena, t->ids(), id) : 0;
+    }
+
+    // Ids of tasks whose title has every word of the query. The rarest
+    // word's list drives; the others seek to each candidate, and any that
+    // overshoots moves the candidate up to where it landed.
+    std::vector<int> search(std::string_view query) const {
+        std::vector<const Term*> lists;
+        bool missing = false;
+        forEachWord(query, [&](std::string_view w) {
+            const Term* t = find(w);
+            if (t) lists.push_back(t);
+            else missing = true;
+        });
+        std::vector<int> result;
+        if (missing || lists.empty()) return result;
+        std::sort(lists.begin(), lists.end(), [](const Term* a, const Term* b) { return a->count < b->count; });
+        std::vector<EliasFano::Cursor> cursors;
+        for (const Term* t : lists) cursors.emplace_back(arena, t->ids());
+        EliasFano::Cursor& lead = cursors[0];
+        while (lead.valid()) {
+            uint32_t candidate = lead.value();
+            bool all = true;
+            for (size_t k = 1; k < cursors.size() && all; ++k) {
+                cursors[k].seek(candidate);
+                if (!cursors[k].valid()) return result;
+                if (cursors[k].value() != candidate) {
+                    all = false;
+                    lead.seek(cursors[k].value());
+                }
+            }
+            if (all) {
+                result.push_back(static_cast<int>(candidate));
+                lead.next();
+            }
+        }
+        return result;
+    }
+};
+
+// Scan fallback with the same matching rule as TitleIndex::search
+static std::vector<int> scanTitles(const TaskSnapshot& snap, std::string_view query) {
+    std::vector<std::string> wanted;
+    forEachWord(query, [&](std::string_view w) { wanted.emplace_back(w); });
+    std::vector<int> result;
+    if (wanted.empty()) return result;
+    std::vector<std::string> have;
+    for (const auto& t : snap) {
+        have.clear();
+        forEachWord(t.getTitle(), [&](std::string_view w) { have.emplace_back(w); });
+        bool all = std::all_of(wanted.begin(), wanted.end(), [&](const std::string& w) {
+            return std::find(have.begin(), have.end(), w) != have.end();
+        });
+        if (all) result.push_back(t.getId());
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Ids ordered by title (case-insensitive), then id
+using TitleOrder = std::vector<int>;
+
+static std::shared_ptr<const TitleOrder> buildTitleOrder(const TaskSnapshot& snap,
+                                                         std::atomic<size_t>* progress = nullptr) {
+    std::vector<std::pair<std::string, int>> keys;
+    keys.reserve(snap.size());
+    for (const auto& t : snap) {
+        std::string key(t.getTitle());
+        for (char& c : key) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        keys.emplace_back(std::move(key), t.getId());
+        if (progress) progress->fetch_add(1, std::memory_order_relaxed);
+    }
+    std::sort(keys.begin(), keys.end());
+    auto order = std::make_shared<TitleOrder>();
+    order->reserve(keys.size());
+    for (const auto& k : keys) order->push_back(k.second);
+    return order;
+}
+
+// BackgroundIndex builds one secondary index from a snapshot on its own
+// thread. Readers never wait for it: get() hands out the index only once a
+// build for the current mutation epoch has finished, and callers scan
+// until then. Snapshots are immutable, so the builder needs no locking.
+template <typename T>
+class BackgroundIndex {
+    std::shared_ptr<const T> ready;
+    uint64_t readyEpoch = 0;
+    bool haveReady = false;
+    std::future<std::shared_ptr<const T>> pending;
+    uint64_t pendingEpoch = 0;
+    std::shared_ptr<std::atomic<size_t>> progress;
+    size_t total = 0;
+
+    // Pick up a finished build without blocking
+    void poll() {
+        if (pending.valid() && pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            ready = pending.get();
+            readyEpoch = pendingEpoch;
+            haveReady = true;
+        }
+    }
+
+public:
+    BackgroundIndex() = default;
+    BackgroundIndex(const BackgroundIndex&) = delete;
+    BackgroundIndex& operator=(const BackgroundIndex&) = delete;
+
+    ~BackgroundIndex() {
+        if (pending.valid()) pending.wait();
+    }
+
+    // Start building for this epoch unless that is already done or under way
+    template <typename Build>
+    void ensure(const TaskSnapshot& snap, uint64_t epoch, Build build) {
+        poll();
+        if (haveReady && readyEpoch == epoch) return;
+        if (pending.valid()) {
+            if (pendingEpoch == epoch) return;
+            // Let an outdated build finish rather than block on it; a newer
+            // one is started on a later call
+            return;
+        }
+        progress = std::make_shared<std::atomic<size_t>>(0);
+        total = snap.size();
+        pendingEpoch = epoch;
+        pending = std::async(std::launch::async, [snap, build, counter = progress] {
+            return build(snap, counter.get());
+        });
+    }
+
+    // Install an index obtained some other way (e.g. mapped from disk)
+    void adopt(std::shared_ptr<const T> index, uint64_t epoch) {
+        ready = std::move(index);
+        readyEpoch = epoch;
+        haveReady = ready != nullptr;
+    }
+
+    // The index if it matches epoch, else null
+    std::shared_ptr<const T> get(uint64_t epoch) {
+        poll();
+        return haveReady && readyEpoch == epoch ? ready : nullptr;
+    }
+
+    // Block until the in-flight build (if any) is done
+    void wait() {
+        if (pending.valid()) pending.wait();
+        poll();
+    }
+
+    bool building() {
+        poll();
+        return pending.valid();
+    }
+
+    // Fraction of the current build done, 0..1
+    double fraction() const {
+        if (!progress || total == 0) return 1.0;
+        return std::min(1.0, static_cast<double>(progress->load(std::memory_order_relaxed)) / total);
+    }
+};
+
+// Task columns a query result can depend on, as bits. Membership covers
+// tasks being added or removed.
+enum TaskColumn : unsigned {
+    kColumnTitle = 1u << 0,
+    kColumnNotes = 1u << 1,
+    kColumnCompleted = 1u << 2,
+    kColumnMembership = 1u << 3,
+    kAllColumns = (1u << 4) - 1,
+};
+constexpr size_t kColumnCount = 4;
+
+// Modification epoch of each column, bumped by TaskManager mutations
+using ColumnEpochs = std::array<uint64_t, kColumnCount>;
+
+// True if every word of `sortedWords` occurs in text (case-insensitive)
+static bool hasAllWords(std::string_view text, const std::vector<std::string>& sortedWords) {
+    if (sortedWords.empty()) return true;
+    std::vector<std::string> have;
+    forEachWord(text, [&](std::string_view w) { have.emplace_back(w); });
+    std::sort(have.begin(), have.end());
+    return std::includes(have.begin(), have.end(), sortedWords.begin(), sortedWords.end());
+}
+
+// TaskQuery is a parsed filter: title words, "notes:" words and an
+// optional "status:open" / "status:done". Words are lower-cased, sorted and
+// deduplicated, so queries that differ only in case, order or repeats get
+// the same key().
+struct TaskQuery {
+    std::vector<std::string> titleWords;
+    std::vector<std::string> notesWords;
+    std::optional<bool> completed;
+
+    static TaskQuery parse(std::string_view text) {
+        TaskQuery q;
+        size_t i = 0;
+        while (i < text.size()) {
+            while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+            size_t start = i;
+            while (i < text.size() && !std::isspace(static_cast<unsigned char>(text[i]))) ++i;
+            std::string_view token = text.substr(start, i - start);
+            if (token.empty()) break;
+            std::string lower(token);
+            for (char& c : lower) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            std::string_view tok = lower;
+            if (tok.rfind("status:", 0) == 0) {
+                std::string_view value = tok.substr(7);
+                if (value == "open") q.completed = false;
+                if (value == "done" || value == "complete") q.completed = true;
+            } else if (tok.rfind("notes:", 0) == 0) {
+                forEachWord(tok.substr(6), [&](std::string_view w) { q.notesWords.emplace_back(w); });
+            } else {
+                forEachWord(tok, [&](std::string_view w) { q.titleWords.emplace_back(w); });
+            }
+        }
+        for (auto* words : {&q.titleWords, &q.notesWords}) {
+            std::sort(words->begin(), words->end());
+            words->erase(std::unique(words->begin(), words->end()), words->end());
+        }
+        return q;
+    }
+
+    std::string key() const {
+        std::string k = completed ? (*completed ? "s=done" : "s=open") : "s=any";
+        k += "|t=";
+        for (const auto& w : titleWords) k += w + " ";
+        k += "|n=";
+        for (const auto& w : notesWords) k += w + " ";
+        return k;
+    }
+
+    // Columns whose changes can alter the result
+    unsigned columns() const {
+        unsigned cols = kColumnMembership;
+        if (!titleWords.empty()) cols |= kColumnTitle;
+        if (!notesWords.empty()) cols |= kColumnNotes;
+        if (completed) cols |= kColumnCompleted;
+        return cols;
+    }
+
+    // Everything but the title words, which callers match via the index
+    bool matchesRest(const Task& t) const {
+        return (!completed || t.isCompleted() == *completed) && hasAllWords(t.getNotes(), notesWords);
+    }
+
+    bool matches(const Task& t) const { return hasAllWords(t.getTitle(), titleWords) && matchesRest(t); }
+};
+
+// QueryCache keeps recent query results (sorted id lists) by query key.
+// Each entry records the epochs of the columns its query reads; it is
+// served only while none of those has moved, so a toggle does not evict a
+// title-only search. Least recently used entries go first once the cache
+// is over its byte limit.
+class QueryCache {
+    struct Entry {
+        std::pmr::vector<uint64_t> arena;  // the ids, Elias-Fano coded
+        EliasFano::List ids;
+        unsigned columns;
+        ColumnEpochs seen;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    std::list<std::string> lru;  // front is most recently used
+    std::unordered_map<std::string, Entry> entries;
+    size_t limitBytes;
+    size_t usedBytes = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+
+    static size_t bytesOf(const std::string& key, const Entry& e) {
+        return sizeof(Entry) + 2 * key.size() + e.arena.capacity() * sizeof(uint64_t);
+    }
+
+    static bool fresh(const Entry& e, const ColumnEpochs& now) {
+        for (size_t c = 0; c < kColumnCount; ++c) {
+            if ((e.columns & (1u << c)) && e.seen[c] != now[c]) return false;
+        }
+        return true;
+    }
+
+    void drop(std::unordered_map<std::string, Entry>::iterator it) {
+        usedBytes -= bytesOf(it->first, it->second);
+        lru.erase(it->second.lruPos);
+        entries.erase(it);
+    }
+
+public:
+    explicit QueryCache(size_t limit = 1 << 20) : limitBytes(limit) {}
+
+    // The cached ids for key if still valid; stale entries are dropped
+    bool get(const std::string& key, const ColumnEpochs& now, std::vector<int>& ids) {
+        auto it = entries.find(key);
+        if (it != entries.end() && fresh(it->second, now)) {
+            lru.splice(lru.begin(), lru, it->second.lruPos);
+            ++hits;
+            ids.clear();
+            ids.reserve(it->second.ids.count);
+            EliasFano::forEach(it->second.arena.data(), it->second.ids,
+                               [&](uint32_t id) { ids.push_back(static_cast<int>(id)); });
+            return true;
+        }
+        if (it != entries.end()) drop(it);
+        ++misses;
+        return false;
+    }
+
+    // ids must be ascending as unsigned values, as they are from queries;
+    // a list that starts with a negative id is not kept
+    void put(const std::string& key, const std::vector<int>& ids, unsigned columns, const ColumnEpochs& now) {
+        auto old = entries.find(key);
+        if (old != entries.end()) drop(old);
+        if (!ids.empty() && ids.front() < 0) return;
+        Entry e{{}, {}, columns, now, {}};
+        EliasFano::Writer out(e.arena, 0);
+        e.ids = EliasFano::append(out, reinterpret_cast<const uint32_t*>(ids.data()), ids.size());
+        e.arena.shrink_to_fit();
+        size_t bytes = bytesOf(key, e);
+        if (bytes > limitBytes) return;
+        while (usedBytes + bytes > limitBytes && !lru.empty()) {
+            drop(entries.find(lru.back()));
+            ++evictions;
+        }
+        lru.push_front(key);
+        e.lruPos = lru.begin();
+        entries.emplace(key, std::move(e));
+        usedBytes += bytes;
+    }
+
+    void setLimit(size_t bytes) {
+        limitBytes = bytes;
+        while (usedBytes > limitBytes && !lru.empty()) {
+            drop(entries.find(lru.back()));
+            ++evictions;
+        }
+    }
+
+    void clear() {
+        entries.clear();
+        lru.clear();
+        usedBytes = 0;
+    }
+
+    size_t size() const { return entries.size(); }
+    size_t bytes() const { return usedBytes; }
+    size_t limit() const { return limitBytes; }
+    size_t hitCount() const { return hits; }
+    size_t missCount() const { return misses; }
+    size_t evictionCount() const { return evictions; }
+};
+
+// TaskManager owns the list of tasks and provides operations. All task
+// storage comes from the memory resource given at construction, so callers
+// can hand in a monotonic buffer for bulk loads or a pool for long runs.
+class TaskManager {
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<Task>;
+
+private:
+    TaskStore tasks;
+    int nextId;
+    // Top half of every version handed out since the last load
+    uint64_t versionBase = newIncarnation();
+    std::string savePath;
+    // Background save still writing, if any; the next save waits for it so
+    // an older snapshot can never overwrite a newer one
+    mutable std::shared_future<bool> pendingSave;
+    // Optional versioned mirror of the list for time-travel queries
+    std::unique_ptr<TaskHistory> history;
+    // Optional write-ahead journal; when set every change is logged first
+    std::unique_ptr<TaskJournal> journal;
+    // Changed since the last load or save
+    bool dirty = false;
+    // Save (and so truncate the journal) after this many commit records
+    size_t checkpointEvery = 0;
+    // Worker threads used by save (see saveSnapshot)
+    unsigned saveThreads = 1;
+    // Fingerprint of the file contents last loaded or saved
+    uint64_t generation = 0;
+    // Bumped by every mutation; secondary indexes are valid for one epoch
+    uint64_t epoch = 0;
+    // Secondary indexes, built in the background (see BackgroundIndex)
+    BackgroundIndex<TitleIndex> titleIndex;
+    BackgroundIndex<TitleOrder> titleOrder;
+    // Out-of-line storage for large notes
+    BlobFiles blobFiles;
+    // Per-column epochs, so cached query results survive unrelated changes
+    ColumnEpochs columnEpochs{};
+    QueryCache queryCache;
+
+    int generateId() { return nextId++; }
+
+    // The next id is kept in a small file beside the snapshot, so an id is
+    // never handed out twice, even once the task holding the highest one
+    // is gone; replicas (see CrdtReplica) rely on that
+    std::string nextIdPath() const { return savePath + ".next"; }
+
+    int savedNextId() const {
+        std::ifstream in(nextIdPath());
+        int id = 0;
+        return in >> id ? id : 0;
+    }
+
+    // Written ahead of the snapshot, whose save syncs the rename
+    bool saveNextId() const {
+        std::string tmp = nextIdPath() + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        bool ok = std::fprintf(f, "%d\n", nextId) > 0 && syncFile(f);
+        ok = std::fclose(f) == 0 && ok;
+        if (ok && std::rename(tmp.c_str(), nextIdPath().c_str()) != 0) {
+            std::remove(nextIdPath().c_str());
+            ok = std::rename(tmp.c_str(), nextIdPath().c_str()) == 0;
+        }
+        return ok;
+    }
+
+    void bumpEpochs(unsigned columns) {
+        dirty = true;
+        ++epoch;
+        for (size_t c = 0; c < kColumnCount; ++c) {
+            if (columns & (1u << c)) ++columnEpochs[c];
+        }
+    }
+
+    // Every mutation reports here, with the columns it changed, so optional
+    // mirrors and cached queries stay in step
+    void touched(const Task& t, unsigned columns) {
+        bumpEpochs(columns);
+        if (history) history->put(t);
+    }
+
+    void modified(Task& t, unsigned columns) {
+        t.bumpVersion();
+        touched(t, columns);
+    }
+
+    // A task new to the store: its version starts over in this incarnation
+    void added(Task& t) {
+        t.setVersion(versionBase + 1);
+        touched(t, kColumnMembership);
+    }
+
+    // Versions a caller read before a reload must never match again, so
+    // each load starts a new incarnation in the top half of every version
+    static uint64_t newIncarnation() {
+        static std::atomic<uint64_t> next{1};
+        return next.fetch_add(1) << 32;
+    }
+
+    void dropped(int id) {
+        bumpEpochs(kColumnMembership);
+        if (history) history->remove(id);
+    }
+
+    void droppedAll() {
+        bumpEpochs(kColumnMembership);
+        if (history) history->clear();
+    }
+
+    static unsigned editedColumns(std::string_view title, std::string_view notes) {
+        return (title.empty() ? 0u : kColumnTitle) | (notes.empty() ? 0u : kColumnNotes);
+    }
+
+    // Apply one resolved op, moving its strings into a task it adds. Adds
+    // are upserts and missing ids are ignored, which keeps journal replay
+    // idempotent.
+    void applyOp(TaskOp& op) {
+        Task* t = op.kind == TaskOp::Kind::Clear ? nullptr : tasks.findMutable(op.id);
+        switch (op.kind) {
+        case TaskOp::Kind::Add:
+            if (op.id >= nextId) nextId = op.id + 1;
+            if (t) {
+                t->setTitle(op.title);
+                t->setNotes(op.notes);
+                t->setCompleted(op.completed);
+                modified(*t, kColumnTitle | kColumnNotes | kColumnCompleted);
+            } else {
+                added(tasks.emplace_back(op.id, std::move(op.title), std::move(op.notes), op.completed));
+            }
+            break;
+        case TaskOp::Kind::Edit:
+            if (!t) break;
+            if (!op.title.empty()) t->setTitle(op.title);
+            if (!op.notes.empty()) t->setNotes(op.notes);
+            modified(*t, editedColumns(op.title, op.notes));
+            break;
+        case TaskOp::Kind::SetCompleted:
+        case TaskOp::Kind::Toggle:
+            if (!t) break;
+            t->setCompleted(op.kind == TaskOp::Kind::Toggle ? !t->isCompleted() : op.completed);
+            modified(*t, kColumnCompleted);
+            break;
+        case TaskOp::Kind::Remove:
+            if (tasks.erase(op.id)) dropped(op.id);
+            break;
+        case TaskOp::Kind::Clear:
+            tasks.clear();
+            droppedAll();
+            break;
+        }
+    }
+
+    // Check a batch against the state its own earlier ops leave behind,
+    // including any expected versions, and turn toggles into absolute
+    // values. Fails without side effects.
+    bool resolve(std::vector<TaskOp>& ops) const {
+        struct State {
+            bool completed;
+            uint64_t version;
+        };
+        // State of tasks the batch touched; nullopt once removed
+        std::unordered_map<int, std::optional<State>> overlay;
+        bool cleared = false;
+        auto lookup = [&](int id) -> std::optional<State> {
+            auto it = overlay.find(id);
+            if (it != overlay.end()) return it->second;
+            if (cleared) return std::nullopt;
+            const Task* t = tasks.find(id);
+            if (!t) return std::nullopt;
+            return State{t->isCompleted(), t->getVersion()};
+        };
+        for (auto& op : ops) {
+            std::optional<State> state;
+            if (op.kind != TaskOp::Kind::Clear) {
+                state = lookup(op.id);
+                if (op.expectedVersion != 0 && (!state || state->version != op.expectedVersion)) {
+                    return false;
+                }
+            }
+            switch (op.kind) {
+            case TaskOp::Kind::Add:
+                if (state) return false;
+                overlay[op.id] = State{op.completed, versionBase + 1};
+                break;
+            case TaskOp::Kind::Edit:
+                if (!state) return false;
+                overlay[op.id] = State{state->completed, state->version + 1};
+                break;
+            case TaskOp::Kind::Toggle:
+                if (!state) return false;
+                op.kind = TaskOp::Kind::SetCompleted;
+                op.completed = !state->completed;
+                overlay[op.id] = State{op.completed, state->version + 1};
+                break;
+            case TaskOp::Kind::SetCompleted:
+                if (!state) return false;
+                overlay[op.id] = State{op.completed, state->version + 1};
+                break;
+            case TaskOp::Kind::Remove:
+                if (!state) return false;
+                overlay[op.id] = std::nullopt;
+                break;
+            case TaskOp::Kind::Clear:
+                overlay.clear();
+                cleared = true;
+                break;
+            }
+        }
+        return true;
+    }
+
+    // All-or-nothing: validate, log one journal record, then apply
+    bool commitOps(std::vector<TaskOp>& ops) {
+        if (!resolve(ops)) return false;
+        if (journal && !journal->append(ops)) return false;
+        for (auto& op : ops) applyOp(op);
+        maybeCheckpoint();
+        return true;
+    }
+
+    // Before a save: move notes of kThreshold bytes or more out of line, then
+    // compact if most of the blob bytes are garbage (or several generations
+    // are in use) by copying the live blobs into a new generation. The new
+    // blobs are synced before the snapshot that names them is written, and
+    // the old files are removed only after it is (see save).
+    bool prepareBlobs() {
+        // Inline notes that look like a marker go out of line too, so a
+        // marker in the file always means a blob
+        auto wantsBlob = [](const Task& t) {
+            std::string_view n = t.storedNotes();
+            return !t.notesOutOfLine()
+                && (n.size() >= BlobStore::kThreshold || n.substr(0, BlobStore::kPrefix.size()) == BlobStore::kPrefix);
+        };
+        BlobStats stats = blobStats();
+        bool compact = blobFiles.count() > 1
+                    || (stats.fileBytes - stats.liveBytes > (64u << 10) && stats.fileBytes > 2 * stats.liveBytes);
+        std::unordered_map<int, bool> pick;
+        for (const auto& t : tasks.snapshot()) {
+            if (wantsBlob(t) || (compact && t.notesOutOfLine())) pick[t.getId()] = true;
+        }
+        if (pick.empty()) return true;
+        std::shared_ptr<BlobStore> store = compact ? blobFiles.next() : blobFiles.current();
+        bool ok = true;
+        tasks.patchEach([&](int id) { return pick.count(id) != 0; }, [&](Task& t) {
+            // A blob that cannot be read fails the save: copying its marker
+            // as the notes would lose them once the old file is dropped
+            std::string_view text;
+            ok = ok && t.readNotes(text);
+            std::optional<BlobStore::Ref> r;
+            if (ok) r = store->append(text);
+            if (r) t.setNotesRef(store, BlobStore::marker(*r));
+            ok = ok && r.has_value();
+            return true;
+        });
+        return ok && store->sync();
+    }
+
+    // Keep replay short: once the journal holds enough records, fold them
+    // into a fresh snapshot
+    void maybeCheckpoint() {
+        if (journal && checkpointEvery && journal->recordCount() >= checkpointEvery) save();
+    }
+
+    // Apply replayed per-id results to the loaded snapshot in one pass
+    void applyReplay(JournalReplayer::Result& r) {
+        if (r.cleared) {
+            tasks.clear();
+            droppedAll();
+        }
+        // Ids the journal saw, even ones since removed, stay used
+        for (const auto& part : r.partitions) {
+            for (const auto& change : part) nextId = std::max(nextId, change.first + 1);
+        }
+        std::unordered_map<int, bool> present;
+        tasks.patchEach([&](int id) { return r.find(id) != nullptr; }, [&](Task& t) {
+            NetChange& c = *r.find(t.getId());
+            present[t.getId()] = true;
+            if (c.kind == NetChange::Kind::Remove) {
+                dropped(t.getId());
+                return false;
+            }
+            if (c.title) t.setTitle(*c.title);
+            if (c.notes) t.setNotes(*c.notes);
+            if (c.completed) t.setCompleted(*c.completed);
+            modified(t, (c.title ? kColumnTitle : 0u) | (c.notes ? kColumnNotes : 0u) |
+                            (c.completed ? kColumnCompleted : 0u));
+            return true;
+        });
+        // Upserts of ids the snapshot lacks become new tasks, in id order
+        std::vector<std::pair<int, NetChange*>> fresh;
+        for (auto& part : r.partitions) {
+            for (auto& [id, c] : part) {
+                if (c.kind == NetChange::Kind::Upsert && !present.count(id)) fresh.emplace_back(id, &c);
+            }
+        }
+        std::sort(fresh.begin(), fresh.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (auto& [id, c] : fresh) {
+            added(tasks.emplace_back(id, *c->title, *c->notes, *c->completed));
+            if (id >= nextId) nextId = id + 1;
+        }
+    }
+
+    bool commitOne(TaskOp op) {
+        std::vector<TaskOp> ops;
+        ops.push_back(std::move(op));
+        return commitOps(ops);
+    }
+
+public:
+    explicit TaskManager(const std::string& filePath = "tasks.csv",
+                         std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : tasks(resource), nextId(1), savePath(filePath), blobFiles(filePath) {}
+
+    TaskManager(const TaskManager&) = delete;
+    TaskManager& operator=(const TaskManager&) = delete;
+
+    ~TaskManager() { waitForSave(); }
+
+    // Transaction buffers a sequence of changes in a private write set and
+    // applies them together on commit, logged as a single journal record.
+    // Ids for added tasks are handed out up front so later steps of the same
+    // transaction can refer to them. An uncommitted transaction is aborted
+    // when destroyed.
+    class Transaction {
+        TaskManager* owner;
+        std::vector<TaskOp> ops;
+
+        friend class TaskManager;
+        explicit Transaction(TaskManager& m) : owner(&m) {}
+
+    public:
+        Transaction(Transaction&&) noexcept = default;
+        Transaction& operator=(Transaction&&) noexcept = default;
+
+        int addTask(std::string_view title, std::string_view notes, bool completed = false) {
+            int id = owner->generateId();
+            ops.push_back(TaskOp::make(TaskOp::Kind::Add, id, title, notes, 0, owner->tasks.resource()));
+            ops.back().completed = completed;
+            return id;
+        }
+
+        void editTask(int id, std::string_view newTitle, std::string_view newNotes) {
+            ops.push_back(TaskOp::make(TaskOp::Kind::Edit, id, newTitle, newNotes));
+        }
+
+        void toggleComplete(int id) { ops.push_back(TaskOp::make(TaskOp::Kind::Toggle, id)); }
+        void removeById(int id) { ops.push_back(TaskOp::make(TaskOp::Kind::Remove, id)); }
+
+        // Conditional steps: the whole transaction fails at commit if the
+        // task is no longer at the version the caller read
+        void editTaskIf(int id, uint64_t expectedVersion, std::string_view newTitle, std::string_view newNotes) {
+            ops.push_back(TaskOp::make(TaskOp::Kind::Edit, id, newTitle, newNotes, expectedVersion));
+        }
+
+        void toggleCompleteIf(int id, uint64_t expectedVersion) {
+            ops.push_back(TaskOp::make(TaskOp::Kind::Toggle, id, {}, {}, expectedVersion));
+        }
+
+        void removeByIdIf(int id, uint64_t expectedVersion) {
+            ops.push_back(TaskOp::make(TaskOp::Kind::Remove, id, {}, {}, expectedVersion));
+        }
+        void clearAll() { ops.push_back(TaskOp::make(TaskOp::Kind::Clear, 0)); }
+
+        size_t size() const { return ops.size(); }
+
+        // Apply everything or nothing. Fails if a step no longer applies
+        // (e.g. its task was removed meanwhile) or the journal write fails.
+        bool commit() {
+            bool ok = owner->commitOps(ops);
+            ops.clear();
+            return ok;
+        }
+
+        void abort() { ops.clear(); }
+    };
+
+    Transaction begin() { return Transaction(*this); }
+
+    // Log every change to a journal (by default next to the task file) and
+    // replay it on load, so nothing committed is lost between saves
+    bool enableJournal(const std::string& path = "") {
+        journal = std::make_unique<TaskJournal>(path.empty() ? savePath + ".journal" : path);
+        return true;
+    }
+
+    // Checkpoint automatically every n commit records (0 turns it off), so
+    // recovery never replays more than n records
+    void setCheckpointInterval(size_t records) { checkpointEvery = records; }
+
+    allocator_type get_allocator() const { return tasks.resource(); }
+    std::pmr::memory_resource* resource() const { return tasks.resource(); }
+
+    // Load tasks from disk if present
+    // Either dialect is accepted (see Task::detectDialect); saving always
+    // writes the quoted one.
+    bool load() {
+        std::unique_ptr<MappedFile> file = MappedFile::open(savePath, tasks.resource());
+        if (!file && !std::ifstream(savePath).is_open()) {
+            // File may not exist on first run, though changes made since
+            // may be in the journal
+            if (!journal || !std::ifstream(journal->filePath()).is_open()) return false;
+        }
+        tasks.clear();
+        droppedAll();
+        versionBase = newIncarnation();
+        blobFiles.clear();
+        std::string_view buf = file ? std::string_view(file->data(), file->size()) : std::string_view();
+        // Same fingerprint as hashing each line plus its newline
+        uint64_t h = fnv1a(kFnvOffset, buf);
+        if (!buf.empty() && buf.back() != '\n') h = fnv1a(h, "\n");
+
+        int maxSeen = 0;
+        auto addRecord = [&](const std::string_view* parts, CsvDialect dialect) {
+            // Decode in place in the store so nothing is copied or moved
+            Task& t = tasks.emplace_back();
+            if (Task::fromFields(parts, t, dialect)) {
+                tasks.noteId(t.getId());
+                blobFiles.attach(t);
+                if (t.getId() > maxSeen) maxSeen = t.getId();
+                added(t);
+            } else {
+                tasks.pop_back();
+            }
+        };
+        size_t firstRecord = buf.find_first_not_of(" \t\r\n");
+        std::string_view firstLine = firstRecord == std::string_view::npos
+                                         ? std::string_view()
+                                         : buf.substr(firstRecord, buf.find('\n', firstRecord) - firstRecord);
+        std::string_view parts[4];
+        if (Task::detectDialect(firstLine) == CsvDialect::Rfc4180) {
+            // Records end at newlines outside quotes; fields at the first
+            // three commas outside quotes, the notes run to the record end
+            size_t fieldStart = 0;
+            size_t count = 0;
+            auto endRecord = [&](size_t end) {
+                if (count == 3) {
+                    std::string_view notes = buf.substr(fieldStart, end - fieldStart);
+                    parts[3] = notes.substr(0, notes.find_last_not_of(" \t\r") + 1);
+                    addRecord(parts, CsvDialect::Rfc4180);
+                }
+                count = 0;
+                fieldStart = end + 1;
+            };
+            CsvScanner::scan(buf, [&](size_t pos, char c) {
+                if (c == '\n') {
+                    endRecord(pos);
+                } else if (count < 3) {
+                    parts[count++] = buf.substr(fieldStart, pos - fieldStart);
+                    fieldStart = pos + 1;
+                }
+            });
+            if (fieldStart < buf.size()) endRecord(buf.size());
+        } else {
+            for (size_t pos = 0; pos < buf.size();) {
+                size_t end = std::min(buf.find('\n', pos), buf.size());
+                std::string_view record = trim(buf.substr(pos, end - pos));
+                pos = end + 1;
+                if (!record.empty() && Task::splitFields(record, parts, 4)) addRecord(parts, CsvDialect::Escaped);
+            }
+        }
+        nextId = std::max(maxSeen + 1, savedNextId());
+        generation = h;
+        // A saved index for exactly this file can be used as-is
+        if (auto saved = TitleIndex::open(indexPath(), generation, tasks.resource())) {
+            titleIndex.adopt(std::move(saved), epoch);
+        }
+        size_t replayed = 0;
+        if (journal) {
+            // Bring the snapshot forward with everything committed since
+            JournalReplayer::Result r = JournalReplayer::run(journal->filePath());
+            applyReplay(r);
+            replayed = r.records;
+            journal->setRecordCount(replayed);
+        }
+        dirty = replayed > 0;
+        return true;
+    }
+
+    // Write a snapshot to any path; safe to call from another thread. The
+    // data goes to a temporary file that is synced and then replaces the
+    // target, and the rename is synced too: a crash mid-save never leaves a
+    // half-written list behind, and once this returns the journal it
+    // covers can be dropped.
+    // The fingerprint of what was written goes to *fingerprint if given.
+    // With threads > 1 large snapshots are encoded and written in parallel.
+    static bool saveSnapshot(const TaskSnapshot& snap, const std::string& path,
+                             uint64_t* fingerprint = nullptr, unsigned threads = 1) {
+        std::string tmpPath = path + ".tmp";
+        uint64_t h = kFnvOffset;
+        size_t workers = std::min<size_t>(threads ? threads : 1, snap.chunkCount() / 16 + 1);
+        if (workers > 1) {
+            if (!writeParallel(tmpPath, snap, workers, h)) return false;
+        } else {
+            // Each chunk keeps its tasks' lines encoded (see TaskChunk), so
+            // this encodes only what changed and writes the rest as it is
+            std::vector<std::string_view> parts;
+            parts.reserve(snap.chunkCount());
+            for (const auto& c : snap.chunkList()) {
+                parts.push_back(c->encoded());
+                h = fnv1a(h, parts.back());
+            }
+            if (!writeParts(tmpPath, parts)) return false;
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            // Windows will not rename over an existing file
+            std::remove(path.c_str());
+            if (std::rename(tmpPath.c_str(), path.c_str()) != 0) return false;
+        }
+        if (!syncParentDir(path)) return false;
+        if (fingerprint) *fingerprint = h;
+        return true;
+    }
+
+    // Write the parts back to back as the whole of a new file, synced
+    static bool writeParts(const std::string& path, const std::vector<std::string_view>& parts) {
+#ifdef _WIN32
+        std::FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) return false;
+        bool ok = true;
+        for (std::string_view p : parts) ok = ok && std::fwrite(p.data(), 1, p.size(), f) == p.size();
+        ok = ok && syncFile(f);
+        return std::fclose(f) == 0 && ok;
+#else
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+#ifdef IOV_MAX
+        constexpr size_t kBatch = IOV_MAX;
+#else
+        constexpr size_t kBatch = 16;
+#endif
+        // One gather write per batch of chunks; a short write resumes
+        // part-way through the first unfinished chunk
+        std::vector<iovec> iov;
+        size_t next = 0;
+        size_t skip = 0;
+        bool ok = true;
+        while (ok && next < parts.size()) {
+            iov.clear();
+            for (size_t i = next; i < parts.size() && iov.size() < kBatch; ++i) {
+                size_t from = i == next ? skip : 0;
+                if (parts[i].size() == from) continue;
+                iov.push_back({const_cast<char*>(parts[i].data() + from), parts[i].size() - from});
+            }
+            if (iov.empty()) break;
+            ssize_t n = ::writev(fd, iov.data(), static_cast<int>(iov.size()));
+            if (n <= 0) {
+                ok = n < 0 && errno == EINTR;
+                continue;
+            }
+            size_t left = static_cast<size_t>(n);
+            while (next < parts.size() && left >= parts[next].size() - skip) {
+                left -= parts[next].size() - skip;
+                skip = 0;
+                ++next;
+            }
+            skip += left;
+        }
+        ok = ok && ::fsync(fd) == 0;
+        return ::close(fd) == 0 && ok;
+#endif
+    }
+
+    // Parallel save: each worker encodes a contiguous range of chunks into
+    // its own buffer, prefix sums of the buffer sizes give every worker its
+    // file offset, and all of them pwrite at once into a file sized up
+    // front. The file is synced once at the end. h gets the fingerprint.
+    static bool writeParallel(const std::string& path, const TaskSnapshot& snap, size_t workers,
+                              uint64_t& h) {
+        const auto& chunks = snap.chunkList();
+        std::vector<std::string> buffers(workers);
+        auto encodeRange = [&](size_t w) {
+            size_t from = chunks.size() * w / workers;
+            size_t to = chunks.size() * (w + 1) / workers;
+            for (size_t ci = from; ci < to; ++ci) buffers[w] += chunks[ci]->encoded();
+        };
+        std::vector<std::thread> pool;
+        for (size_t w = 1; w < workers; ++w) pool.emplace_back(encodeRange, w);
+        encodeRange(0);
+        for (auto& t : pool) t.join();
+        pool.clear();
+
+        std::vector<size_t> offsets(workers + 1, 0);
+        for (size_t w = 0; w < workers; ++w) offsets[w + 1] = offsets[w] + buffers[w].size();
+#ifdef _WIN32
+        std::vector<std::string_view> parts(buffers.begin(), buffers.end());
+        for (std::string_view p : parts) h = fnv1a(h, p);
+        return writeParts(path, parts);
+#else
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = ::ftruncate(fd, static_cast<off_t>(offsets[workers])) == 0;
+        std::vector<char> wrote(workers, 0);
+        auto writeRange = [&](size_t w) {
+            const std::string& b = buffers[w];
+            size_t done = 0;
+            while (done < b.size()) {
+                ssize_t n = ::pwrite(fd, b.data() + done, b.size() - done,
+                                     static_cast<off_t>(offsets[w] + done));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return;
+                done += static_cast<size_t>(n);
+            }
+            wrote[w] = 1;
+        };
+        if (ok) {
+            for (size_t w = 1; w < workers; ++w) pool.emplace_back(writeRange, w);
+            writeRange(0);
+            // The fingerprint is sequential; work it out while the rest write
+            for (const auto& b : buffers) h = fnv1a(h, b);
+            for (auto& t : pool) t.join();
+            ok = std::all_of(wrote.begin(), wrote.end(), [](char c) { return c != 0; });
+        }
+        ok = ok && ::fsync(fd) == 0;
+        return ::close(fd) == 0 && ok;
+#endif
+    }
+
+    // Save with this many worker threads (1, the default, saves serially)
+    void setSaveThreads(unsigned threads) { saveThreads = threads ? threads : 1; }
+
+    std::string indexPath() const { return savePath + ".idx"; }
+
+    // Save tasks to disk. With history on, each successful save also
+    // commits a version, once the snapshot it stands for is written.
+    // A successful save checkpoints the journal.
+    bool save() {
+        waitForSave();
+        if (!prepareBlobs()) return false;
+        TaskSnapshot snap = tasks.snapshot();
+        if (!saveNextId() || !saveSnapshot(snap, savePath, &generation, saveThreads)) return false;
+        // The new snapshot names only the newest blob file
+        blobFiles.dropOld();
+        if (history) history->commit("save");
+        dirty = false;
+        // Store the index beside the snapshot so the next load skips the build
+        auto index = titleIndex.get(epoch);
+        if (!index) {
+            index = TitleIndex::build(snap, generation, tasks.resource());
+            titleIndex.adopt(index, epoch);
+        }
+        index->write(indexPath(), generation);
+        return !journal || journal->truncate();
+    }
+
+    bool hasUnsavedChanges() const { return dirty; }
+
+    struct BlobStats {
+        size_t outOfLine;    // tasks whose notes live in a blob
+        uint64_t liveBytes;  // blob bytes those tasks refer to
+        uint64_t fileBytes;  // size of the blob files, garbage included
+    };
+
+    BlobStats blobStats() {
+        BlobStats s{0, 0, blobFiles.totalBytes()};
+        BlobStore::Ref r;
+        for (const auto& t : tasks.snapshot()) {
+            if (t.notesOutOfLine() && BlobStore::parseMarker(t.storedNotes(), r)) {
+                ++s.outOfLine;
+                s.liveBytes += BlobStore::kHeaderSize + r.length;
+            }
+        }
+        return s;
+    }
+
+    // Rough bytes held by this list, for memory budgets
+    size_t memoryUsage() const { return sizeof(*this) + tasks.memoryUsage(); }
+
+    // Save a frozen copy of the current list on a background thread. Editing
+    // can continue right away; only chunks touched meanwhile get copied.
+    // The memory resource must be thread-safe when this is used.
+    std::shared_future<bool> saveAsync() const {
+        waitForSave();
+        saveNextId();
+        pendingSave = std::async(std::launch::async,
+                                 [snap = tasks.snapshot(), path = savePath, n = saveThreads] {
+                                     return saveSnapshot(snap, path, nullptr, n);
+                                 }).share();
+        return pendingSave;
+    }
+
+    void waitForSave() const {
+        if (pendingSave.valid()) pendingSave.wait();
+    }
+
+    // CRUD operations. With a journal each one is a single-op transaction;
+    // addTask returns -1 if the journal write fails.
+    int addTask(std::string_view title, std::string_view notes) {
+        int id = generateId();
+        if (journal) return commitOne(TaskOp::make(TaskOp::Kind::Add, id, title, notes, 0, tasks.resource())) ? id : -1;
+        added(tasks.emplace_back(id, title, notes, false));
+        return id;
+    }
+
+    // Adopt an already-built task, assigning it a fresh id. Its strings are
+    // moved over when it shares this manager's memory resource.
+    int addTask(Task&& task) {
+        if (journal) {
+            TaskOp op(tasks.resource());
+            op.kind = TaskOp::Kind::Add;
+            op.id = generateId();
+            op.completed = task.isCompleted();
+            task.takeStrings(op.title, op.notes);
+            int id = op.id;
+            return commitOne(std::move(op)) ? id : -1;
+        }
+        task.setId(generateId());
+        Task& t = tasks.emplace_back(std::move(task));
+        added(t);
+        return t.getId();
+    }
+
+    // Bulk add for imports: next(title, notes, completed) fills in one new
+    // task per call until it returns false. The tasks go straight into the
+    // store with fresh ids and no journal records, so nothing reaches disk
+    // until the next save(). Returns how many were added.
+    template <typename Next>
+    long addTasks(Next next) {
+        long count = 0;
+        std::string_view title, notes;
+        bool completed = false;
+        while (next(title, notes, completed)) {
+            added(tasks.emplace_back(generateId(), title, notes, completed));
+            ++count;
+        }
+        return count;
+    }
+
+    bool removeById(int id) {
+        if (journal) return commitOne(TaskOp::make(TaskOp::Kind::Remove, id));
+        if (!tasks.erase(id)) return false;
+        dropped(id);
+        return true;
+    }
+
+    bool toggleComplete(int id) {
+        if (journal) return commitOne(TaskOp::make(TaskOp::Kind::Toggle, id));
+        Task* t = tasks.findMutable(id);
+        if (!t) return false;
+        t->setCompleted(!t->isCompleted());
+        modified(*t, kColumnCompleted);
+        return true;
+    }
+
+    bool editTask(int id, std::string_view newTitle, std::string_view newNotes) {
+        if (journal) return commitOne(TaskOp::make(TaskOp::Kind::Edit, id, newTitle, newNotes));
+        Task* t = tasks.findMutable(id);
+        if (!t) return false;
+        if (!newTitle.empty()) t->setTitle(newTitle);
+        if (!newNotes.empty()) t->setNotes(newNotes);
+        modified(*t, editedColumns(newTitle, newNotes));
+        return true;
+    }
+
+    // Compare-and-set variants for optimistic concurrency: read a task and
+    // its version with find(), decide, then apply only if nobody changed it
+    // in between. On false, re-read and retry (or give up if it is gone).
+    // These are not lock-free: TaskManager is not thread-safe, so clients
+    // sharing one must still serialize every call, find() included, behind
+    // one lock. What they save is holding it across the whole
+    // read-decide-write cycle. Versions live in memory only; each load
+    // starts a new incarnation, so a version read before a reload (or a
+    // Workspace eviction) fails the check instead of matching by chance.
+    bool editTaskIf(int id, uint64_t expectedVersion, std::string_view newTitle, std::string_view newNotes) {
+        return commitOne(TaskOp::make(TaskOp::Kind::Edit, id, newTitle, newNotes, expectedVersion));
+    }
+
+    bool toggleCompleteIf(int id, uint64_t expectedVersion) {
+        return commitOne(TaskOp::make(TaskOp::Kind::Toggle, id, {}, {}, expectedVersion));
+    }
+
+    bool removeByIdIf(int id, uint64_t expectedVersion) {
+        return commitOne(TaskOp::make(TaskOp::Kind::Remove, id, {}, {}, expectedVersion));
+    }
+
+    // Insert or replace a task under a known id (0 picks a new one), for
+    // sync and import paths that carry whole records. Returns the id, or
+    // -1 if the journal write fails.
+    int putTask(int id, std::string_view title, std::string_view notes, bool completed) {
+        if (id <= 0) id = generateId();
+        std::vector<TaskOp> ops;
+        ops.push_back(TaskOp::make(TaskOp::Kind::Add, id, title, notes, 0, tasks.resource()));
+        ops[0].completed = completed;
+        if (journal && !journal->append(ops)) return -1;
+        applyOp(ops[0]);
+        maybeCheckpoint();
+        return id;
+    }
+
+    const Task* find(int id) const { return tasks.find(id); }
+
+    // Ids (ascending) of tasks whose title contains every word of query,
+    // case-insensitively. Scans while the index is still being built.
+    std::vector<int> searchTitles(std::string_view query) {
+        if (auto index = titleIndex.get(epoch)) return index->search(query);
+        buildIndexesInBackground();
+        return scanTitles(tasks.snapshot(), query);
+    }
+
+    // Ids in title order. Sorts on the spot while the index is being built.
+    std::vector<int> idsByTitle() {
+        if (auto order = titleOrder.get(epoch)) return *order;
+        buildIndexesInBackground();
+        return *buildTitleOrder(tasks.snapshot());
+    }
+
+    // Ids (ascending) of tasks matching a filter query (see TaskQuery).
+    // Results are cached until a column the query reads changes.
+    std::vector<int> query(std::string_view text) {
+        TaskQuery q = TaskQuery::parse(text);
+        std::string key = q.key();
+        std::vector<int> ids;
+        if (queryCache.get(key, columnEpochs, ids)) return ids;
+        if (!q.titleWords.empty()) {
+            std::string words;
+            for (const auto& w : q.titleWords) words += w + " ";
+            // One pass over the tasks against the sorted hits: looking each
+            // hit up by id would scan the store once per hit
+            std::vector<int> hits = searchTitles(words);
+            if (!hits.empty()) {
+                for (const auto& t : tasks.snapshot()) {
+                    if (std::binary_search(hits.begin(), hits.end(), t.getId()) && q.matchesRest(t)) {
+                        ids.push_back(t.getId());
+                    }
+                }
+            }
+            std::sort(ids.begin(), ids.end());
+        } else {
+            for (const auto& t : tasks.snapshot()) {
+                if (q.matchesRest(t)) ids.push_back(t.getId());
+            }
+            std::sort(ids.begin(), ids.end());
+        }
+        queryCache.put(key, ids, q.columns(), columnEpochs);
+        return ids;
+    }
+
+    void setQueryCacheLimit(size_t bytes) { queryCache.setLimit(bytes); }
+    const QueryCache& queryCacheStats() const { return queryCache; }
+
+    // Start building any secondary index that does not match the current
+    // tasks. Returns immediately; queries scan until each one is ready.
+    void buildIndexesInBackground() {
+        TaskSnapshot snap = tasks.snapshot();
+        std::pmr::memory_resource* res = tasks.resource();
+        uint64_t gen = generation;
+        titleIndex.ensure(snap, epoch, [res, gen](const TaskSnapshot& s, std::atomic<size_t>* p) {
+            return TitleIndex::build(s, gen, res, p);
+        });
+        titleOrder.ensure(snap, epoch, [](const TaskSnapshot& s, std::atomic<size_t>* p) {
+            return buildTitleOrder(s, p);
+        });
+    }
+
+    struct IndexStatus {
+        bool ready;
+        bool building;
+        double progress;
+        size_t bytes = 0;       // held in memory, when ready
+        size_t plainBytes = 0;  // the same postings as plain id arrays
+    };
+
+    IndexStatus titleIndexStatus() {
+        auto index = titleIndex.get(epoch);
+        IndexStatus s{index != nullptr, titleIndex.building(), titleIndex.fraction()};
+        if (index) {
+            s.bytes = index->byteSize();
+            s.plainBytes = index->byteSize() - index->postingBytes() + index->postings() * sizeof(uint32_t);
+        }
+        return s;
+    }
+
+    IndexStatus titleOrderStatus() {
+        return {titleOrder.get(epoch) != nullptr, titleOrder.building(), titleOrder.fraction()};
+    }
+
+    // Cheap frozen view of the current list (see TaskSnapshot)
+    TaskSnapshot list() const { return tasks.snapshot(); }
+
+    bool clearAll() {
+        if (journal) return commitOne(TaskOp::make(TaskOp::Kind::Clear, 0));
+        tasks.clear();
+        droppedAll();
+        return true;
+    }
+
+    // Start keeping versions of the list. The current contents become the
+    // first version; later ones are committed on every save or on demand.
+    TaskHistory& enableHistory() {
+        if (!history) {
+            history = std::make_unique<TaskHistory>(tasks.resource());
+            for (const auto& t : tasks.snapshot()) history->put(t);
+            history->commit("start");
+        }
+        return *history;
+    }
+
+    // Commit the current list as a named version (history must be enabled)
+    int commitVersion(const std::string& tag) { return enableHistory().commit(tag); }
+
+    const TaskHistory* versions() const { return history.get(); }
+};
+
+// Workspace manages many task lists, one file per list, and keeps only the
+// most recently used ones in memory. A list is loaded on first access;
+// when the resident lists outgrow the memory budget the least recently
+// used one is saved back to its file and dropped. Lists the caller still
+// holds a handle to are pinned and never evicted. Each list journals its
+// edits, so none are lost if the process dies before the write-back.
+class Workspace {
+    struct Entry {
+        std::shared_ptr<TaskManager> manager;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    std::string directory;
+    size_t budgetBytes;
+    std::pmr::memory_resource* res;
+    std::list<std::string> lru;  // front is most recently used
+    std::unordered_map<std::string, Entry> resident;
+    size_t hits = 0;
+    size_t loads = 0;
+    size_t evictions = 0;
+
+    bool writeBack(const Entry& e) {
+        return !e.manager->hasUnsavedChanges() || e.manager->save();
+    }
+
+    // Evict from the cold end until under budget, never touching `keep`
+    void enforceBudget(const std::string& keep) {
+        size_t total = residentBytes();
+        auto it = lru.end();
+        while (total > budgetBytes && it != lru.begin()) {
+            --it;
+            if (*it == keep) continue;
+            Entry& e = resident.at(*it);
+            if (e.manager.use_count() > 1) continue;
+            size_t bytes = e.manager->memoryUsage();
+            if (!writeBack(e)) continue;
+            total -= bytes;
+            resident.erase(*it);
+            it = lru.erase(it);
+            ++evictions;
+        }
+    }
+
+public:
+    Workspace(std::string dir, size_t budget,
+              std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : directory(std::move(dir)), budgetBytes(budget), res(resource) {}
+
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+
+    ~Workspace() { flushAll(); }
+
+    std::string pathFor(const std::string& name) const {
+        return directory.empty() ? name + ".csv" : directory + "/" + name + ".csv";
+    }
+
+    // Get a list by name, loading it if it is not resident
+    std::shared_ptr<TaskManager> open(const std::string& name) {
+        auto found = resident.find(name);
+        if (found != resident.end()) {
+            lru.splice(lru.begin(), lru, found->second.lruPos);
+            ++hits;
+            return found->second.manager;
+        }
+        auto manager = std::make_shared<TaskManager>(pathFor(name), res);
+        manager->enableJournal();
+        manager->load();
+        ++loads;
+        lru.push_front(name);
+        resident.emplace(name, Entry{manager, lru.begin()});
+        enforceBudget(name);
+        return manager;
+    }
+
+    // Save and drop one list now; fails if it is pinned or the save fails
+    bool evict(const std::string& name) {
+        auto found = resident.find(name);
+        if (found == resident.end()) return true;
+        if (found->second.manager.use_count() > 1 || !writeBack(found->second)) return false;
+        lru.erase(found->second.lruPos);
+        resident.erase(found);
+        ++evictions;
+        return true;
+    }
+
+    // Write every resident list with unsaved changes back to its file
+    bool flushAll() {
+        bool ok = true;
+        for (auto& entry : resident) ok = writeBack(entry.second) && ok;
+        return ok;
+    }
+
+    size_t residentCount() const { return resident.size(); }
+
+    size_t residentBytes() const {
+        size_t total = 0;
+        for (const auto& entry : resident) total += entry.second.manager->memoryUsage();
+        return total;
+    }
+
+    size_t hitCount() const { return hits; }
+    size_t loadCount() const { return loads; }
+    size_t evictionCount() const { return evictions; }
+};
+
+// TaskFileReader streams a task file one record at a time, so tools can
+// work on files of any size. It also notes whether ids arrive in order.
+class TaskFileReader {
+    std::ifstream in;
+    std::string line;
+    int lastId = 0;
+    bool first = true;
+    bool ordered = true;
+    std::optional<CsvDialect> dialect;  // from the first record
+    BlobFiles blobs;
+
+public:
+    explicit TaskFileReader(const std::string& path) : in(path), blobs(path) {}
+
+    bool isOpen() const { return in.is_open(); }
+
+    // Next well-formed record; blank and malformed lines are skipped.
+    // Either dialect is read (see Task::detectDialect).
+    bool next(Task& out) {
+        while (dialect == CsvDialect::Rfc4180 ? readCsvRecord(in, line) : static_cast<bool>(std::getline(in, line))) {
+            std::string_view record = trim(line);
+            if (record.empty()) continue;
+            if (!dialect) {
+                dialect = Task::detectDialect(record);
+                // The first record may go on over more lines
+                std::string more;
+                while (dialect == CsvDialect::Rfc4180 && !Task::quotesBalanced(line) && std::getline(in, more)) {
+                    line += '\n';
+                    line += more;
+                }
+                record = trim(line);
+            }
+            if (!Task::fromCsv(record, out, *dialect)) continue;
+            blobs.attach(out);
+            if (!first && out.getId() <= lastId) ordered = false;
+            first = false;
+            lastId = out.getId();
+            return true;
+        }
+        return false;
+    }
+
+    // False once a record came with an id not above the one before it
+    bool inIdOrder() const { return ordered; }
+};
+
+static bool sameContent(const Task& a, const Task& b) {
+    return a.isCompleted() == b.isCompleted() && a.getTitle() == b.getTitle()
+        && a.getNotes() == b.getNotes();
+}
+
+// Join up to three task files by id and call visit(id, rows) once per id in
+// ascending order, where rows[i] is that id's task in file i or null.
+// Files written by save() are in id order, so this is normally a single
+// streaming merge-join pass with one record per file in memory. If a file
+// turns out not to be sorted, the join is redone with every file held in
+// hash tables; visit must then tolerate being restarted (onRestart runs
+// first so callers can drop what they produced).
+template <typename Visit, typename Restart>
+static bool joinTaskFiles(const std::vector<std::string>& paths, Visit visit, Restart onRestart) {
+    const size_t n = paths.size();
+    {
+        std::vector<std::unique_ptr<TaskFileReader>> readers;
+        std::vector<Task> current(n);
+        std::vector<bool> has(n);
+        for (size_t i = 0; i < n; ++i) {
+            readers.push_back(std::make_unique<TaskFileReader>(paths[i]));
+            if (!readers[i]->isOpen()) return false;
+            has[i] = readers[i]->next(current[i]);
+        }
+        bool ordered = true;
+        std::vector<const Task*> rows(n);
+        while (ordered) {
+            int minId = 0;
+            bool any = false;
+            for (size_t i = 0; i < n; ++i) {
+                if (has[i] && (!any || current[i].getId() < minId)) {
+                    minId = current[i].getId();
+                    any = true;
+                }
+            }
+            if (!any) return true;
+            for (size_t i = 0; i < n; ++i) {
+                rows[i] = has[i] && current[i].getId() == minId ? &current[i] : nullptr;
+            }
+            visit(minId, rows.data());
+            for (size_t i = 0; i < n; ++i) {
+                if (rows[i]) {
+                    has[i] = readers[i]->next(current[i]);
+                    if (!readers[i]->inIdOrder()) ordered = false;
+                }
+            }
+        }
+    }
+
+    // Fallback for unsorted input: hash every file by id
+    onRestart();
+    std::vector<std::unordered_map<int, Task>> tables(n);
+    std::vector<int> ids;
+    for (size_t i = 0; i < n; ++i) {
+        TaskFileReader reader(paths[i]);
+        Task t;
+        while (reader.next(t)) {
+            if (tables[i].emplace(t.getId(), t).second) ids.push_back(t.getId());
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    std::vector<const Task*> rows(n);
+    for (int id : ids) {
+        for (size_t i = 0; i < n; ++i) {
+            auto it = tables[i].find(id);
+            rows[i] = it == tables[i].end() ? nullptr : &it->second;
+        }
+        visit(id, rows.data());
+    }
+    return true;
+}
+
+struct MergeStats {
+    size_t added = 0;
+    size_t removed = 0;
+    size_t changed = 0;
+    size_t unchanged = 0;
+    std::vector<std::string> conflicts;
+};
+
+static std::string describeTask(const Task& t) {
+    return std::to_string(t.getId()) + " \"" + std::string(t.getTitle()) + "\"";
+}
+
+// Compare two task files: one report line per added, removed or changed
+// task, in id order. False if a file cannot be opened.
+static bool diffTaskFiles(const std::string& oldPath, const std::string& newPath, std::vector<std::string>& report,
+                          MergeStats& stats) {
+    report.clear();
+    stats = MergeStats();
+    return joinTaskFiles(
+        {oldPath, newPath},
+        [&](int, const Task* const* rows) {
+            const Task* a = rows[0];
+            const Task* b = rows[1];
+            if (!a) {
+                ++stats.added;
+                report.push_back("+ " + describeTask(*b));
+            } else if (!b) {
+                ++stats.removed;
+                report.push_back("- " + describeTask(*a));
+            } else if (!sameContent(*a, *b)) {
+                ++stats.changed;
+                std::string what;
+                if (a->getTitle() != b->getTitle()) what += " title";
+                if (a->getNotes() != b->getNotes()) what += " notes";
+                if (a->isCompleted() != b->isCompleted()) what += " status";
+                report.push_back("~ " + describeTask(*b) + ":" + what);
+            } else {
+                ++stats.unchanged;
+            }
+        },
+        [&] {
+            report.clear();
+            stats = MergeStats();
+        });
+}
+
+// Print the diff of two task files, followed by totals
+static int runDiff(const std::string& oldPath, const std::string& newPath) {
+    std::vector<std::string> report;
+    MergeStats stats;
+    if (!diffTaskFiles(oldPath, newPath, report, stats)) {
+        std::cerr << "Could not open input files.\n";
+        return 1;
+    }
+    for (const auto& line : report) std::cout << line << "\n";
+    std::cout << stats.added << " added, " << stats.removed << " removed, "
+              << stats.changed << " changed, " << stats.unchanged << " unchanged\n";
+    return 0;
+}
+
+// Merge task files by id into outPath. With a base file this is a 3-way
+// merge: each field takes whichever side changed it, and a task deleted on
+// one side stays deleted unless the other side edited it. Without a base,
+// both files' tasks are kept. Either way, when both sides changed the same
+// thing differently, ours wins and the conflict is noted in stats. False
+// if an input cannot be read or the output written.
+static bool mergeTaskFiles(const std::string* basePath, const std::string& oursPath, const std::string& theirsPath,
+                           const std::string& outPath, MergeStats& stats) {
+    std::string tmpPath = outPath + ".tmp";
+    std::ofstream out;
+    std::vector<std::string> paths;
+    if (basePath) paths.push_back(*basePath);
+    paths.push_back(oursPath);
+    paths.push_back(theirsPath);
+    const size_t off = basePath ? 1 : 0;
+
+    auto pick = [&](const Task* base, const Task& ours, const Task& theirs, Task& merged) {
+        bool conflict = false;
+        auto choose = [&](auto o, auto t, auto b) {
+            if (o == t) return o;
+            if (base && o == b) return t;
+            if (base && t == b) return o;
+            conflict = true;
+            return o;
+        };
+        merged = Task(ours.getId(),
+                      choose(ours.getTitle(), theirs.getTitle(), base ? base->getTitle() : std::string_view()),
+                      choose(std::string_view(ours.getNotes()), std::string_view(theirs.getNotes()),
+                             base ? std::string_view(base->getNotes()) : std::string_view()),
+                      choose(ours.isCompleted(), theirs.isCompleted(), base && base->isCompleted()));
+        if (conflict) stats.conflicts.push_back("both changed " + describeTask(ours));
+    };
+
+    auto open = [&] {
+        out.close();
+        out.open(tmpPath, std::ios::trunc);
+        stats = MergeStats();
+    };
+    open();
+    if (!out.is_open()) return false;
+
+    Task merged;
+    bool ok = joinTaskFiles(
+        paths,
+        [&](int, const Task* const* rows) {
+            const Task* base = basePath ? rows[0] : nullptr;
+            const Task* ours = rows[off];
+            const Task* theirs = rows[off + 1];
+            const Task* keep = nullptr;
+            if (ours && theirs) {
+                pick(base, *ours, *theirs, merged);
+                keep = &merged;
+                if (sameContent(*ours, *theirs)) ++stats.unchanged;
+                else ++stats.changed;
+            } else if (!base) {
+                // Present on one side only and new there
+                keep = ours ? ours : theirs;
+                ++stats.added;
+            } else {
+                // Deleted on one side: honour it unless the other side edited
+                const Task* other = ours ? ours : theirs;
+                if (!other) {
+                    ++stats.removed;
+                } else if (sameContent(*other, *base)) {
+                    ++stats.removed;
+                } else {
+                    keep = other;
+                    stats.conflicts.push_back("edited and deleted " + describeTask(*other));
+                }
+            }
+            if (keep && keep->notesOutOfLine()) {
+                // The inputs' blob files do not travel with OUT
+                Task copy(*keep);
+                copy.setNotes(keep->getNotes());
+                out << copy.toCsv() << "\n";
+            } else if (keep) {
+                out << keep->toCsv() << "\n";
+            }
+        },
+        open);
+    out.close();
+    if (!ok || !out) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    std::remove(outPath.c_str());
+    return std::rename(tmpPath.c_str(), outPath.c_str()) == 0;
+}
+
+static int runMerge(const std::string* basePath, const std::string& oursPath,
+                    const std::string& theirsPath, const std::string& outPath) {
+    MergeStats stats;
+    if (!mergeTaskFiles(basePath, oursPath, theirsPath, outPath, stats)) {
+        std::cerr << "Could not read inputs or write " << outPath << ".\n";
+        return 1;
+    }
+    for (const auto& c : stats.conflicts) std::cout << "conflict: " << c << "\n";
+    std::cout << "Merged into " << outPath << ": " << stats.added << " added, "
+              << stats.removed << " removed, " << stats.changed << " changed, "
+              << stats.conflicts.size() << " conflicts\n";
+    return stats.conflicts.empty() ? 0 : 3;
+}
+
+// Tournament tree over k sorted sources. tree[0] holds the source with the
+// current winner and each inner node the loser of the match played there,
+// so replacing the winner replays only the log2(k) matches on its path.
+// beats(a, b) says source a's head goes out before source b's.
+template <typename Beats>
+class LoserTree {
+    std::vector<int> tree;
+    Beats beats;
+
+    void replay(int s) {
+        for (size_t t = (static_cast<size_t>(s) + tree.size()) / 2; t > 0; t /= 2) {
+            if (tree[t] < 0) {
+                // Still filling: wait here for the other side of this match
+                tree[t] = s;
+                return;
+            }
+            if (beats(tree[t], s)) std::swap(tree[t], s);
+        }
+        tree[0] = s;
+    }
+
+public:
+    LoserTree(size_t k, Beats b) : tree(k, -1), beats(b) {
+        for (size_t i = k; i-- > 0;) replay(static_cast<int>(i));
+    }
+
+    int winner() const { return tree[0]; }
+    // Call after the winner's source has moved on to its next record
+    void advance() { replay(tree[0]); }
+};
+
+enum class SortKey { Id, Title, Status };
+
+// Out-of-core sort of a task file. Records are read in batches that fit the
+// memory budget; each batch is sorted and written to a run file next to the
+// output, and the runs are merged k ways with a loser tree (several passes
+// if there are more runs than the budget has room to read at once). Equal
+// keys keep their input order, so unique keeps the first record of an id.
+class ExternalSorter {
+public:
+    struct Options {
+        SortKey key = SortKey::Id;
+        bool unique = false;  // drop later records with an id already written
+        size_t memoryBytes = size_t(256) << 20;
+        CsvDialect dialect = CsvDialect::Rfc4180;
+    };
+
+    struct Stats {
+        size_t records = 0;
+        size_t written = 0;
+        size_t duplicates = 0;
+        size_t runs = 0;
+        size_t passes = 0;
+    };
+
+    explicit ExternalSorter(const Options& o) : opts(o) {}
+
+    ~ExternalSorter() {
+        for (const auto& p : temps) std::remove(p.c_str());
+    }
+
+    bool sort(const std::string& inPath, const std::string& outPath, Stats& stats) {
+        stats = Stats();
+        prefix = outPath;
+        TaskFileReader in(inPath);
+        if (!in.isOpen()) return false;
+
+        // Run generation
+        std::vector<std::string> runs;
+        std::vector<Task> batch;
+        size_t heap = 0;
+        Task t;
+        bool more = in.next(t);
+        while (more) {
+            heap += t.heapBytes();
+            batch.push_back(std::move(t));
+            ++stats.records;
+            more = in.next(t);
+            // Capacity is kept across runs, so count what the batch holds
+            if (batch.size() * sizeof(Task) + heap < opts.memoryBytes && more) continue;
+            std::stable_sort(batch.begin(), batch.end(), [this](const Task& a, const Task& b) { return less(a, b); });
+            if (runs.empty() && !more) {
+                // Everything fit: no run files needed
+                ++stats.passes;
+                return writeSorted(batch, outPath, stats);
+            }
+            runs.push_back(tempPath());
+            Stats ignored;
+            if (!writeRecords(runs.back(), CsvDialect::Rfc4180, false, ignored,
+                              [&, i = size_t(0)](Task& out) mutable {
+                                  if (i == batch.size()) return false;
+                                  out = std::move(batch[i++]);
+                                  return true;
+                              })) {
+                return false;
+            }
+            batch.clear();
+            heap = 0;
+        }
+        stats.runs = runs.size();
+        if (runs.empty()) {
+            ++stats.passes;
+            return writeSorted(batch, outPath, stats);
+        }
+
+        // Each open run costs a stream buffer and one record
+        const size_t fanIn = std::clamp<size_t>(opts.memoryBytes / (64 << 10), 2, 256);
+        while (runs.size() > fanIn) {
+            std::vector<std::string> merged;
+            for (size_t i = 0; i < runs.size(); i += fanIn) {
+                std::vector<std::string> group(runs.begin() + i, runs.begin() + std::min(runs.size(), i + fanIn));
+                merged.push_back(tempPath());
+                Stats ignored;
+                if (!merge(group, merged.back(), CsvDialect::Rfc4180, false, ignored)) return false;
+                for (const auto& p : group) std::remove(p.c_str());
+            }
+            runs = std::move(merged);
+            ++stats.passes;
+        }
+        ++stats.passes;
+        return merge(runs, outPath, opts.dialect, opts.unique, stats);
+    }
+
+private:
+    Options opts;
+    std::string prefix;
+    std::vector<std::string> temps;
+
+    std::string tempPath() {
+        temps.push_back(prefix + ".run" + std::to_string(temps.size()) + ".tmp");
+        return temps.back();
+    }
+
+    // Same order as TaskManager::idsByTitle for titles; open before done
+    bool less(const Task& a, const Task& b) const {
+        if (opts.key == SortKey::Title) {
+            std::string_view x = a.getTitle(), y = b.getTitle();
+            size_t n = std::min(x.size(), y.size());
+            for (size_t i = 0; i < n; ++i) {
+                int cx = std::tolower(static_cast<unsigned char>(x[i]));
+                int cy = std::tolower(static_cast<unsigned char>(y[i]));
+                if (cx != cy) return cx < cy;
+            }
+            if (x.size() != y.size()) return x.size() < y.size();
+        } else if (opts.key == SortKey::Status && a.isCompleted() != b.isCompleted()) {
+            return b.isCompleted();
+        }
+        return a.getId() < b.getId();
+    }
+
+    bool writeSorted(std::vector<Task>& batch, const std::string& outPath, Stats& stats) {
+        return writeRecords(outPath, opts.dialect, opts.unique, stats, [&, i = size_t(0)](Task& out) mutable {
+            if (i == batch.size()) return false;
+            out = std::move(batch[i++]);
+            return true;
+        });
+    }
+
+    bool merge(const std::vector<std::string>& runs, const std::string& outPath,
+               CsvDialect dialect, bool unique, Stats& stats) {
+        std::vector<std::unique_ptr<TaskFileReader>> readers;
+        std::vector<Task> heads(runs.size());
+        std::vector<bool> has(runs.size());
+        for (size_t i = 0; i < runs.size(); ++i) {
+            readers.push_back(std::make_unique<TaskFileReader>(runs[i]));
+            if (!readers[i]->isOpen()) return false;
+            has[i] = readers[i]->next(heads[i]);
+        }
+        // Ties go to the earlier run, which holds the earlier input
+        auto beats = [&](int a, int b) {
+            if (!has[a] || !has[b]) return has[a] && !has[b];
+            if (less(heads[a], heads[b])) return true;
+            return !less(heads[b], heads[a]) && a < b;
+        };
+        LoserTree<decltype(beats)> tree(runs.size(), beats);
+        return writeRecords(outPath, dialect, unique, stats, [&](Task& out) {
+            int w = tree.winner();
+            if (!has[w]) return false;
+            out = std::move(heads[w]);
+            has[w] = readers[w]->next(heads[w]);
+            tree.advance();
+            return true;
+        });
+    }
+
+    // Write records from next(task) to path (through a temp file); with
+    // unique the input must be in id order. Notes always go out inline.
+    template <typename Next>
+    bool writeRecords(const std::string& path, CsvDialect dialect, bool unique, Stats& stats, Next next) {
+        const std::string tmp = path + ".tmp";
+        std::ofstream out(tmp, std::ios::trunc | std::ios::binary);
+        if (!out.is_open()) return false;
+        std::string buf;
+        Task t;
+        bool any = false;
+        int lastId = 0;
+        while (next(t)) {
+            if (unique && any && t.getId() == lastId) {
+                ++stats.duplicates;
+                continue;
+            }
+            any = true;
+            lastId = t.getId();
+            if (t.notesOutOfLine()) t.setNotes(std::string(t.getNotes()));
+            buf += t.toCsv(dialect);
+            buf += '\n';
+            ++stats.written;
+            if (buf.size() >= (1 << 20)) {
+                out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+                buf.clear();
+            }
+        }
+        out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        out.close();
+        if (!out) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        std::remove(path.c_str());
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+};
+
+static int runSort(const std::vector<std::string>& args) {
+    ExternalSorter::Options opts;
+    std::vector<std::string> paths;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& a = args[i];
+        bool hasValue = i + 1 < args.size();
+        if (a == "--unique") {
+            opts.unique = true;
+        } else if (a == "--by" && hasValue) {
+            const std::string& v = args[++i];
+            if (v == "id") opts.key = SortKey::Id;
+            else if (v == "title") opts.key = SortKey::Title;
+            else if (v == "status") opts.key = SortKey::Status;
+            else return 2;
+        } else if (a == "--memory" && hasValue) {
+            int mb = 0;
+            if (!parseInt(args[++i], mb) || mb <= 0) return 2;
+            opts.memoryBytes = static_cast<size_t>(mb) << 20;
+        } else if (a == "--format" && hasValue) {
+            const std::string& v = args[++i];
+            if (v == "csv") opts.dialect = CsvDialect::Rfc4180;
+            else if (v == "escaped") opts.dialect = CsvDialect::Escaped;
+            else return 2;
+        } else if (a.compare(0, 2, "--") == 0) {
+            return 2;
+        } else {
+            paths.push_back(a);
+        }
+    }
+    if (paths.size() != 2) return 2;
+    if (opts.unique && opts.key != SortKey::Id) {
+        std::cerr << "--unique needs --by id.\n";
+        return 2;
+    }
+    ExternalSorter::Stats stats;
+    ExternalSorter sorter(opts);
+    if (!sorter.sort(paths[0], paths[1], stats)) {
+        std::cerr << "Could not read " << paths[0] << " or write " << paths[1] << ".\n";
+        return 1;
+    }
+    std::cout << "Sorted " << stats.records << " tasks into " << paths[1] << ": "
+              << stats.runs << " runs, " << stats.passes << " passes";
+    if (opts.unique) std::cout << ", " << stats.duplicates << " duplicates dropped";
+    std::cout << "\n";
+    return 0;
+}
+
+// Hybrid logical clock timestamp: wall time in ms, a logical counter for
+// events within the same ms, and the replica id as the final tie-break,
+// so any two timestamps from different replicas are strictly ordered.
+struct Hlc {
+    uint64_t wall = 0;
+    uint32_t logical = 0;
+    uint32_t replica = 0;
+
+    bool operator<(const Hlc& o) const {
+        return std::tie(wall, logical, replica) < std::tie(o.wall, o.logical, o.replica);
+    }
+    bool operator==(const Hlc& o) const {
+        return wall == o.wall && logical == o.logical && replica == o.replica;
+    }
+
+    std::string str() const {
+        return std::to_string(wall) + "." + std::to_string(logical) + "." + std::to_string(replica);
+    }
+
+    static bool parse(std::string_view s, Hlc& out) {
+        size_t a = s.find('.');
+        size_t b = a == std::string_view::npos ? a : s.find('.', a + 1);
+        if (b == std::string_view::npos) return false;
+        auto num = [](std::string_view v, auto& dst) {
+            auto res = std::from_chars(v.data(), v.data() + v.size(), dst);
+            return res.ec == std::errc() && res.ptr == v.data() + v.size();
+        };
+        return num(s.substr(0, a), out.wall) && num(s.substr(a + 1, b - a - 1), out.logical)
+            && num(s.substr(b + 1), out.replica);
+    }
+};
+
+class HybridClock {
+    Hlc last;
+
+    static uint64_t physicalMs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+public:
+    explicit HybridClock(uint32_t replica) { last.replica = replica; }
+
+    const Hlc& latest() const { return last; }
+
+    // Timestamp for a local event
+    Hlc now() {
+        uint64_t pt = physicalMs();
+        if (pt > last.wall) {
+            last.wall = pt;
+            last.logical = 0;
+        } else {
+            ++last.logical;
+        }
+        return last;
+    }
+
+    // Move past a timestamp received from another replica
+    void observe(const Hlc& remote) {
+        uint64_t pt = physicalMs();
+        uint64_t w = std::max({pt, last.wall, remote.wall});
+        if (w == last.wall && w == remote.wall) last.logical = std::max(last.logical, remote.logical) + 1;
+        else if (w == last.wall) ++last.logical;
+        else if (w == remote.wall) last.logical = remote.logical + 1;
+        else last.logical = 0;
+        last.wall = w;
+    }
+};
+
+// Last-writer-wins register: the value with the highest timestamp survives
+template <typename T>
+struct LwwRegister {
+    T value{};
+    Hlc stamp;
+
+    bool merge(const LwwRegister& other) {
+        if (!(stamp < other.stamp)) return false;
+        *this = other;
+        return true;
+    }
+};
+
+// CrdtReplica is one replica's conflict-free view of a task list for
+// offline editing. Membership is an add-wins observed-remove set (each add
+// carries a unique tag; a remove only cancels the tags it has seen, so a
+// concurrent add survives), and title, notes and completion are LWW
+// registers stamped with a hybrid logical clock. Merging is commutative
+// and idempotent, so replicas can exchange deltas in any order.
+//
+// Tasks are identified across replicas by a uid (creating replica in the
+// high 32 bits, a per-replica sequence below) and mapped to the ordinary
+// ids of the local TaskManager. Every entry remembers the local clock
+// reading of its last change, so a delta for a peer only carries entries
+// changed since the last delta that peer acknowledged. A peer acknowledges
+// a delta by importing it whole and then sending a delta back; until then
+// each delta repeats what the earlier ones held, so one that is lost or
+// never imported costs nothing.
+//
+// Removed tasks stay as tombstones for good. Dropping one is only safe
+// once every replica has seen the remove, and a replica does not know
+// which others exist.
+class CrdtReplica {
+public:
+    struct Entry {
+        std::set<Hlc> adds;
+        std::set<Hlc> removes;
+        LwwRegister<std::string> title;
+        LwwRegister<std::string> notes;
+        LwwRegister<bool> completed;
+        Hlc changed;     // local clock at the last change, for deltas
+        int localId = 0; // id in the local TaskManager, 0 if none yet
+
+        bool present() const {
+            for (const auto& tag : adds) {
+                if (!removes.count(tag)) return true;
+            }
+            return false;
+        }
+    };
+
+private:
+    uint32_t replicaId;
+    uint32_t nextSeq = 1;
+    HybridClock clock;
+    std::map<uint64_t, Entry> entries;
+    std::unordered_map<int, uint64_t> byLocal;
+
+    // Deltas sent to a peer, by the name exports use for it
+    struct Peer {
+        Hlc acked;                 // clock of the newest delta it acknowledged
+        std::vector<Hlc> pending;  // clocks of later deltas, oldest first
+    };
+    static constexpr size_t kMaxPending = 16;  // older ones are just re-sent
+    std::map<std::string, Peer> peers;
+    std::map<uint32_t, Hlc> received;  // replica -> newest whole delta imported from it
+
+    static std::string joinTags(const std::set<Hlc>& tags) {
+        std::string out;
+        for (const auto& t : tags) {
+            if (!out.empty()) out += ';';
+            out += t.str();
+        }
+        return out;
+    }
+
+    static bool splitTags(std::string_view s, std::set<Hlc>& out) {
+        while (!s.empty()) {
+            size_t end = s.find(';');
+            Hlc tag;
+            if (!Hlc::parse(s.substr(0, end), tag)) return false;
+            out.insert(tag);
+            s = end == std::string_view::npos ? std::string_view() : s.substr(end + 1);
+        }
+        return true;
+    }
+
+    static void writeEntry(std::ostream& out, uint64_t uid, const Entry& e, bool withLocal) {
+        out << "t," << uid << "," << (withLocal ? e.localId : 0) << "," << e.changed.str() << ","
+            << joinTags(e.adds) << "," << joinTags(e.removes) << ","
+            << e.completed.stamp.str() << "," << (e.completed.value ? 1 : 0) << ","
+            << e.title.stamp.str() << "," << e.notes.stamp.str() << ","
+            << Task::quoteField(e.title.value) << "," << Task::quoteField(e.notes.value) << "\n";
+    }
+
+    // Files end their header line with ",q" when text is in the quoted
+    // dialect; older ones used the escaped one. Strips the marker.
+    static CsvDialect headerDialect(std::string& header) {
+        if (header.size() < 2 || header.compare(header.size() - 2, 2, ",q") != 0) return CsvDialect::Escaped;
+        header.resize(header.size() - 2);
+        return CsvDialect::Rfc4180;
+    }
+
+    // Next line, or next record (possibly several lines) when quoted
+    static bool readLine(std::istream& in, std::string& line, CsvDialect dialect) {
+        if (dialect == CsvDialect::Rfc4180) return readCsvRecord(in, line);
+        return static_cast<bool>(std::getline(in, line));
+    }
+
+    static bool readEntry(std::string_view line, uint64_t& uid, Entry& e, CsvDialect dialect) {
+        std::string_view f[11];
+        if (line.rfind("t,", 0) != 0) return false;
+        line = line.substr(2);
+        if (!(dialect == CsvDialect::Rfc4180 ? Task::splitQuoted(line, f, 11) : Task::splitFields(line, f, 11))) {
+            return false;
+        }
+        auto res = std::from_chars(f[0].data(), f[0].data() + f[0].size(), uid);
+        int done = 0;
+        std::string scratch;
+        e = Entry();
+        if (res.ec != std::errc() || !parseInt(f[1], e.localId) || !Hlc::parse(f[2], e.changed)
+            || !splitTags(f[3], e.adds) || !splitTags(f[4], e.removes)
+            || !Hlc::parse(f[5], e.completed.stamp) || !parseInt(f[6], done)
+            || !Hlc::parse(f[7], e.title.stamp) || !Hlc::parse(f[8], e.notes.stamp)) {
+            return false;
+        }
+        e.completed.value = done != 0;
+        e.title.value = Task::decodeField(f[9], scratch, dialect);
+        e.notes.value = Task::decodeField(f[10], scratch, dialect);
+        return true;
+    }
+
+    static uint32_t randomReplicaId() {
+        std::random_device rd;
+        uint32_t id = rd();
+        return id ? id : 1;
+    }
+
+    // Fold a remote entry into ours; true if anything changed
+    bool mergeEntry(uint64_t uid, const Entry& remote) {
+        Entry& e = entries[uid];
+        bool changed = false;
+        for (const auto& tag : remote.adds) changed = e.adds.insert(tag).second || changed;
+        for (const auto& tag : remote.removes) changed = e.removes.insert(tag).second || changed;
+        changed = e.title.merge(remote.title) || changed;
+        changed = e.notes.merge(remote.notes) || changed;
+        changed = e.completed.merge(remote.completed) || changed;
+        if (changed) e.changed = clock.now();
+        return changed;
+    }
+
+public:
+    explicit CrdtReplica(uint32_t id = randomReplicaId()) : replicaId(id), clock(id) {}
+
+    uint32_t id() const { return replicaId; }
+    size_t size() const { return entries.size(); }
+
+    // Turn local edits made through TaskManager since the last materialize
+    // into CRDT operations stamped with the current time
+    void absorb(const TaskManager& manager) {
+        std::unordered_map<int, bool> seen;
+        for (const auto& t : manager.list()) {
+            seen[t.getId()] = true;
+            auto mapped = byLocal.find(t.getId());
+            if (mapped == byLocal.end()) {
+                uint64_t uid = (static_cast<uint64_t>(replicaId) << 32) | nextSeq++;
+                Entry& e = entries[uid];
+                Hlc ts = clock.now();
+                e.adds.insert(ts);
+                e.title = {std::string(t.getTitle()), ts};
+                e.notes = {std::string(t.getNotes()), ts};
+                e.completed = {t.isCompleted(), ts};
+                e.changed = ts;
+                e.localId = t.getId();
+                byLocal[t.getId()] = uid;
+                continue;
+            }
+            Entry& e = entries[mapped->second];
+            if (e.title.value != t.getTitle()) e.title = {std::string(t.getTitle()), clock.now()};
+            if (std::string_view(t.getNotes()) != e.notes.value) e.notes = {std::string(t.getNotes()), clock.now()};
+            if (e.completed.value != t.isCompleted()) e.completed = {t.isCompleted(), clock.now()};
+            e.changed = std::max({e.changed, e.title.stamp, e.notes.stamp, e.completed.stamp});
+        }
+        for (auto it = byLocal.begin(); it != byLocal.end();) {
+            Entry& e = entries[it->second];
+            if (seen.count(it->first)) {
+                ++it;
+                continue;
+            }
+            if (e.present()) {
+                // Removed locally: cancel every add tag observed so far
+                e.removes.insert(e.adds.begin(), e.adds.end());
+                e.changed = clock.now();
+            }
+            e.localId = 0;
+            it = byLocal.erase(it);
+        }
+    }
+
+    // Make the TaskManager match the merged state
+    void materialize(TaskManager& manager) {
+        for (auto& [uid, e] : entries) {
+            const Task* t = e.localId ? manager.find(e.localId) : nullptr;
+            if (e.present()) {
+                if (t && t->getTitle() == e.title.value && std::string_view(t->getNotes()) == e.notes.value
+                    && t->isCompleted() == e.completed.value) {
+                    continue;
+                }
+                int id = manager.putTask(t ? e.localId : 0, e.title.value, e.notes.value, e.completed.value);
+                if (id > 0 && id != e.localId) {
+                    byLocal.erase(e.localId);
+                    e.localId = id;
+                    byLocal[id] = uid;
+                }
+            } else if (e.localId) {
+                // Gone everywhere: the local id now belongs to nothing, so a
+                // task that shows up under it later is a new one
+                if (t) manager.removeById(e.localId);
+                byLocal.erase(e.localId);
+                e.localId = 0;
+            }
+        }
+    }
+
+    // Write entries changed since the last delta this peer acknowledged,
+    // acknowledging in turn every whole delta imported here
+    bool exportDelta(const std::string& peer, const std::string& path) {
+        Peer& p = peers[peer];
+        Hlc upTo = clock.now();
+        std::ofstream out(path, std::ios::trunc);
+        if (!out.is_open()) return false;
+        out << "delta," << replicaId << "," << upTo.str() << ",q\n";
+        for (const auto& [from, at] : received) out << "a," << from << "," << at.str() << "\n";
+        size_t count = 0;
+        for (const auto& [uid, e] : entries) {
+            if (p.acked < e.changed) {
+                writeEntry(out, uid, e, false);
+                ++count;
+            }
+        }
+        // Lets the importer tell a whole delta from a cut-off one
+        out << "end," << count << "\n";
+        out.close();
+        if (!out) return false;
+        p.pending.push_back(upTo);
+        if (p.pending.size() > kMaxPending) p.pending.erase(p.pending.begin());
+        return true;
+    }
+
+    // A peer has every entry of our delta cut at clock at
+    void acknowledged(const Hlc& at) {
+        for (auto& [name, p] : peers) {
+            auto it = std::find(p.pending.begin(), p.pending.end(), at);
+            if (it == p.pending.end()) continue;
+            p.acked = at;
+            p.pending.erase(p.pending.begin(), it + 1);
+        }
+    }
+
+    // Merge a delta file from another replica; returns entries changed or
+    // -1 if the file could not be read
+    int importDelta(const std::string& path) {
+        std::ifstream in(path);
+        std::string line;
+        if (!in.is_open() || !std::getline(in, line) || line.rfind("delta,", 0) != 0) return -1;
+        CsvDialect dialect = headerDialect(line);
+        std::string_view f[2];
+        uint32_t from = 0;
+        Hlc upTo;
+        if (!Task::splitFields(std::string_view(line).substr(6), f, 2)
+            || std::from_chars(f[0].data(), f[0].data() + f[0].size(), from).ec != std::errc()
+            || !Hlc::parse(f[1], upTo)) {
+            return -1;
+        }
+        clock.observe(upTo);
+        int changed = 0;
+        size_t count = 0;
+        bool whole = false;
+        while (readLine(in, line, dialect)) {
+            uint64_t uid = 0;
+            Entry remote;
+            if (line.rfind("a,", 0) == 0) {
+                uint32_t replica = 0;
+                Hlc at;
+                if (Task::splitFields(std::string_view(line).substr(2), f, 2)
+                    && std::from_chars(f[0].data(), f[0].data() + f[0].size(), replica).ec == std::errc()
+                    && replica == replicaId && Hlc::parse(f[1], at)) {
+                    acknowledged(at);
+                }
+            } else if (line.rfind("end,", 0) == 0) {
+                whole = std::to_string(count) == std::string_view(line).substr(4);
+            } else if (readEntry(line, uid, remote, dialect)) {
+                ++count;
+                if (mergeEntry(uid, remote)) ++changed;
+            }
+        }
+        // Only a whole delta is acknowledged back to its sender
+        if (whole && (!received.count(from) || received[from] < upTo)) received[from] = upTo;
+        return changed;
+    }
+
+    bool saveState(const std::string& path) const {
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::trunc);
+            if (!out.is_open()) return false;
+            out << "crdt," << replicaId << "," << nextSeq << "," << clock.latest().str() << ",q\n";
+            for (const auto& [name, p] : peers) {
+                out << "p," << p.acked.str() << "," << Task::quoteField(name) << "\n";
+                for (const auto& at : p.pending) out << "s," << at.str() << "," << Task::quoteField(name) << "\n";
+            }
+            for (const auto& [from, at] : received) out << "r," << from << "," << at.str() << "\n";
+            for (const auto& [uid, e] : entries) writeEntry(out, uid, e, true);
+            out.close();
+            if (!out) return false;
+        }
+        std::remove(path.c_str());
+        return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+    // Load saved state; false (leaving a fresh replica) if there is none
+    bool loadState(const std::string& path) {
+        std::ifstream in(path);
+        std::string line;
+        if (!in.is_open() || !std::getline(in, line) || line.rfind("crdt,", 0) != 0) return false;
+        CsvDialect dialect = headerDialect(line);
+        std::string_view f[3];
+        int seq = 0;
+        Hlc last;
+        if (!Task::splitFields(std::string_view(line).substr(5), f, 3)
+            || std::from_chars(f[0].data(), f[0].data() + f[0].size(), replicaId).ec != std::errc()
+            || !parseInt(f[1], seq) || !Hlc::parse(f[2], last)) {
+            return false;
+        }
+        nextSeq = static_cast<uint32_t>(seq);
+        clock = HybridClock(replicaId);
+        clock.observe(last);
+        entries.clear();
+        byLocal.clear();
+        peers.clear();
+        received.clear();
+        std::string scratch;
+        while (readLine(in, line, dialect)) {
+            // p: a peer's acknowledged clock, s: a delta it has not yet
+            // acknowledged, r: the newest delta imported from a replica
+            if (line.rfind("p,", 0) == 0 || line.rfind("s,", 0) == 0) {
+                Hlc at;
+                if (Task::splitFields(std::string_view(line).substr(2), f, 2) && Hlc::parse(f[0], at)) {
+                    Peer& p = peers[std::string(Task::decodeField(f[1], scratch, dialect))];
+                    if (line[0] == 'p') p.acked = at;
+                    else p.pending.push_back(at);
+                }
+                continue;
+            }
+            if (line.rfind("r,", 0) == 0) {
+                uint32_t from = 0;
+                Hlc at;
+                if (Task::splitFields(std::string_view(line).substr(2), f, 2)
+                    && std::from_chars(f[0].data(), f[0].data() + f[0].size(), from).ec == std::errc()
+                    && Hlc::parse(f[1], at)) {
+                    received[from] = at;
+                }
+                continue;
+            }
+            uint64_t uid = 0;
+            Entry e;
+            if (!readEntry(line, uid, e, dialect)) continue;
+            if (e.localId) byLocal[e.localId] = uid;
+            entries[uid] = std::move(e);
+        }
+        return true;
+    }
+};
+
+// Offline sync commands. The replica state lives next to the task file;
+// local edits, journaled ones included, are folded in before every exchange.
+static bool syncExport(const std::string& tasksPath, const std::string& peer, const std::string& deltaPath) {
+    TaskManager manager(tasksPath);
+    manager.enableJournal();
+    manager.load();
+    CrdtReplica replica;
+    replica.loadState(tasksPath + ".crdt");
+    replica.absorb(manager);
+    return replica.exportDelta(peer, deltaPath) && replica.saveState(tasksPath + ".crdt");
+}
+
+// Returns the number of changed tasks, -1 if the delta could not be read
+// or -2 if the results could not be written
+static int syncImport(const std::string& tasksPath, const std::string& deltaPath) {
+    TaskManager manager(tasksPath);
+    manager.enableJournal();
+    manager.load();
+    CrdtReplica replica;
+    replica.loadState(tasksPath + ".crdt");
+    replica.absorb(manager);
+    int changed = replica.importDelta(deltaPath);
+    if (changed < 0) return -1;
+    replica.materialize(manager);
+    if (!manager.save() || !replica.saveState(tasksPath + ".crdt")) return -2;
+    return changed;
+}
+
+static int runSyncExport(const std::string& tasksPath, const std::string& peer, const std::string& deltaPath) {
+    if (!syncExport(tasksPath, peer, deltaPath)) {
+        std::cerr << "Could not write sync files.\n";
+        return 1;
+    }
+    std::cout << "Wrote changes for " << peer << " to " << deltaPath << "\n";
+    return 0;
+}
+
+static int runSyncImport(const std::string& tasksPath, const std::string& deltaPath) {
+    int changed = syncImport(tasksPath, deltaPath);
+    if (changed == -1) {
+        std::cerr << "Could not read " << deltaPath << ".\n";
+        return 1;
+    }
+    if (changed < 0) {
+        std::cerr << "Could not write sync files.\n";
+        return 1;
+    }
+    std::cout << "Merged " << changed << " changed tasks into " << tasksPath << "\n";
+    return 0;
+}
+
+// One task as read by an importer. The views point into the input or the
+// reader's buffers and hold until the next record is read.
+struct ImportedTask {
+    std::string_view title;
+    std::string_view notes;
+    bool completed = false;
+};
+
+static bool isIsoDate(std::string_view s) {
+    if (s.size() != 10 || s[4] != '-' || s[7] != '-') return false;
+    for (size_t i : {0, 1, 2, 3, 5, 6, 8, 9}) {
+        if (!std::isdigit(static_cast<unsigned char>(s[i]))) return false;
+    }
+    return true;
+}
+
+// Fields other tools keep that a Task has no column for go at the front of
+// the notes as "priority:A due:YYYY-MM-DD", so notes: searches find them
+static void addImportTags(std::string& notes, char priority, std::string_view due) {
+    if (priority) {
+        notes += "priority:";
+        notes += priority;
+    }
+    if (!due.empty()) {
+        if (!notes.empty()) notes += ' ';
+        notes += "due:";
+        notes += due;
+    }
+}
+
+// Streaming todo.txt parser (one task per line: "x" and dates when done,
+// "(A)" priority, then the description with +project, @context and
+// key:value tags). due: and pri: tags become notes; the rest of the
+// description is the title. Lines are parsed in place; a title is a view
+// of its line unless tags or extra spaces have to come out, and then it is
+// built in a reused buffer, so reading allocates nothing once it has grown.
+class TodoTxtReader {
+    std::string_view rest;
+    std::string title;
+    std::string notes;
+
+    static std::string_view skipDate(std::string_view s) {
+        if (s.size() > 10 && isIsoDate(s.substr(0, 10)) && s[10] == ' ') return s.substr(11);
+        return s;
+    }
+
+public:
+    explicit TodoTxtReader(std::string_view data) : rest(data) {}
+
+    bool next(ImportedTask& out) {
+        while (!rest.empty()) {
+            size_t nl = rest.find('\n');
+            std::string_view line = trim(rest.substr(0, nl));
+            rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+            if (line.empty()) continue;
+
+            bool completed = false;
+            char priority = 0;
+            if (line.size() > 2 && line[0] == 'x' && line[1] == ' ') {
+                completed = true;
+                line = skipDate(skipDate(trim(line.substr(2))));
+            } else if (line.size() > 4 && line[0] == '(' && line[1] >= 'A' && line[1] <= 'Z' && line[2] == ')'
+                       && line[3] == ' ') {
+                priority = line[1];
+                line = skipDate(trim(line.substr(4)));
+            } else {
+                line = skipDate(line);
+            }
+
+            // The title stays a view of the line for as long as its words
+            // follow each other one space apart; the first tag or extra
+            // space copies it to the buffer
+            title.clear();
+            size_t kept = 0;
+            bool copied = false;
+            std::string_view due;
+            size_t i = 0;
+            while (i < line.size()) {
+                while (i < line.size() && line[i] == ' ') ++i;
+                size_t start = i;
+                i = std::min(line.find(' ', i), line.size());
+                std::string_view word = line.substr(start, i - start);
+                if (word.empty()) break;
+                bool tag = true;
+                if (word.size() == 14 && word.compare(0, 4, "due:") == 0 && isIsoDate(word.substr(4))) {
+                    due = word.substr(4);
+                } else if (word.size() == 5 && word.compare(0, 4, "pri:") == 0 && word[4] >= 'A' && word[4] <= 'Z') {
+                    priority = word[4];
+                } else {
+                    tag = false;
+                }
+                if (!copied && !tag && start == (kept ? kept + 1 : 0)) {
+                    kept = i;
+                    continue;
+                }
+                if (!copied) {
+                    title.assign(line.substr(0, kept));
+                    copied = true;
+                }
+                if (tag) continue;
+                if (!title.empty()) title += ' ';
+                title += word;
+            }
+            std::string_view text = copied ? std::string_view(title) : line.substr(0, kept);
+            if (text.empty()) continue;
+            notes.clear();
+            addImportTags(notes, priority, due);
+            out.title = text;
+            out.notes = notes;
+            out.completed = completed;
+            return true;
+        }
+        return false;
+    }
+};
+
+// Streaming iCalendar (RFC 5545) parser that reads the VTODO components
+// and ignores everything else. SUMMARY is the title and DESCRIPTION the
+// notes; STATUS:COMPLETED, COMPLETED or PERCENT-COMPLETE:100 mark it done;
+// PRIORITY 1-9 becomes A-I and DUE a due: tag. Folded lines and escapes
+// are undone in reused buffers; unfolded lines are parsed in place.
+class ICalendarReader {
+    std::string_view rest;
+    std::string unfolded;
+    std::string summary;
+    std::string description;
+    std::string notes;
+
+    // b is upper case; names are ASCII, so no locale is consulted
+    static bool equalsNoCase(std::string_view a, std::string_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            char c = a[i] >= 'a' && a[i] <= 'z' ? static_cast<char>(a[i] - 'a' + 'A') : a[i];
+            if (c != b[i]) return false;
+        }
+        return true;
+    }
+
+    // Next content line with continuation lines joined
+    bool nextLine(std::string_view& line) {
+        while (!rest.empty()) {
+            size_t nl = rest.find('\n');
+            std::string_view raw = rest.substr(0, nl);
+            rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+            if (!raw.empty() && raw.back() == '\r') raw.remove_suffix(1);
+            if (!rest.empty() && (rest[0] == ' ' || rest[0] == '\t')) {
+                unfolded.assign(raw);
+                while (!rest.empty() && (rest[0] == ' ' || rest[0] == '\t')) {
+                    nl = rest.find('\n');
+                    std::string_view more = rest.substr(1, nl == std::string_view::npos ? nl : nl - 1);
+                    rest = nl == std::string_view::npos ? std::string_view() : rest.substr(nl + 1);
+                    if (!more.empty() && more.back() == '\r') more.remove_suffix(1);
+                    unfolded += more;
+                }
+                raw = unfolded;
+            }
+            if (!raw.empty()) {
+                line = raw;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // TEXT value escapes: \n, \, \; and backslash itself
+    static void unescape(std::string_view value, std::string& out) {
+        out.clear();
+        size_t i = 0;
+        for (size_t at = value.find('\\'); at != std::string_view::npos; at = value.find('\\', i)) {
+            out.append(value.data() + i, at - i);
+            if (at + 1 == value.size()) {
+                i = at;
+                break;
+            }
+            char c = value[at + 1];
+            out += c == 'n' || c == 'N' ? '\n' : c;
+            i = at + 2;
+        }
+        out.append(value.data() + i, value.size() - i);
+    }
+
+public:
+    explicit ICalendarReader(std::string_view data) : rest(data) {}
+
+    static bool looksLike(std::string_view data) {
+        if (data.substr(0, 3) == "\xEF\xBB\xBF") data.remove_prefix(3);
+        data = trim(data.substr(0, 64));
+        return data.size() >= 15 && equalsNoCase(data.substr(0, 15), "BEGIN:VCALENDAR");
+    }
+
+    bool next(ImportedTask& out) {
+        std::string_view line;
+        bool inTodo = false;
+        int nested = 0;  // depth of components inside the VTODO (VALARM)
+        bool completed = false;
+        char priority = 0;
+        char due[10];
+        bool hasDue = false;
+        while (nextLine(line)) {
+            // NAME;PARAM=...:VALUE, where quoted parameters may hold ':'
+            size_t colon = std::min(line.find(':'), line.size());
+            if (line.substr(0, colon).find('"') != std::string_view::npos) {
+                colon = 0;
+                bool quoted = false;
+                while (colon < line.size() && (quoted || line[colon] != ':')) {
+                    if (line[colon] == '"') quoted = !quoted;
+                    ++colon;
+                }
+            }
+            if (colon == line.size()) continue;
+            std::string_view name = line.substr(0, std::min(colon, line.find(';')));
+            std::string_view value = line.substr(colon + 1);
+
+            if (equalsNoCase(name, "BEGIN")) {
+                if (inTodo) {
+                    ++nested;
+                } else if (equalsNoCase(value, "VTODO")) {
+                    inTodo = true;
+                    summary.clear();
+                    description.clear();
+                    completed = false;
+                    priority = 0;
+                    hasDue = false;
+                }
+                continue;
+            }
+            if (!inTodo) continue;
+            if (equalsNoCase(name, "END")) {
+                if (nested) {
+                    --nested;
+                    continue;
+                }
+                inTodo = false;
+                std::string_view title = summary;
+                if (title.empty()) title = std::string_view(description).substr(0, description.find('\n'));
+                if (trim(title).empty()) continue;
+                for (char& c : summary) {
+                    if (c == '\n' || c == '\r') c = ' ';
+                }
+                notes.clear();
+                addImportTags(notes, priority, hasDue ? std::string_view(due, 10) : std::string_view());
+                if (!description.empty()) {
+                    if (!notes.empty()) notes += '\n';
+                    notes += description;
+                }
+                out.title = trim(title);
+                out.notes = notes;
+                out.completed = completed;
+                return true;
+            }
+            if (nested) continue;
+            if (equalsNoCase(name, "SUMMARY")) {
+                unescape(value, summary);
+            } else if (equalsNoCase(name, "DESCRIPTION")) {
+                unescape(value, description);
+            } else if (equalsNoCase(name, "STATUS")) {
+                completed = completed || equalsNoCase(value, "COMPLETED");
+            } else if (equalsNoCase(name, "COMPLETED")) {
+                completed = true;
+            } else if (equalsNoCase(name, "PERCENT-COMPLETE")) {
+                completed = completed || trim(value) == "100";
+            } else if (equalsNoCase(name, "PRIORITY")) {
+                int p = 0;
+                if (parseInt(value, p) && p >= 1 && p <= 9) priority = static_cast<char>('A' + p - 1);
+            } else if (equalsNoCase(name, "DUE") && value.size() >= 8
+                       && std::all_of(value.begin(), value.begin() + 8,
+                                      [](char c) { return std::isdigit(static_cast<unsigned char>(c)); })) {
+                // DATE or DATE-TIME; the time of day is dropped
+                std::memcpy(due, value.data(), 4);
+                due[4] = '-';
+                std::memcpy(due + 5, value.data() + 4, 2);
+                due[7] = '-';
+                std::memcpy(due + 8, value.data() + 6, 2);
+                hasDue = true;
+            }
+        }
+        return false;
+    }
+};
+
+// Feed an importer's tasks to manager in one bulk add (see addTasks);
+// the caller saves them
+template <typename Reader>
+static long importTasks(TaskManager& manager, std::string_view data) {
+    Reader reader(data);
+    ImportedTask t;
+    return manager.addTasks([&](std::string_view& title, std::string_view& notes, bool& completed) {
+        if (!reader.next(t)) return false;
+        title = t.title;
+        notes = t.notes;
+        completed = t.completed;
+        return true;
+    });
+}
+
+// Add the tasks of a todo.txt or iCalendar file to a task file
+static int runImport(const std::string& tasksPath, const std::string& inPath) {
+    auto in = MappedFile::open(inPath, std::pmr::get_default_resource());
+    if (!in) {
+        std::cerr << "Could not read " << inPath << ".\n";
+        return 1;
+    }
+    TaskManager manager(tasksPath);
+    manager.enableJournal();
+    manager.load();
+    std::string_view data(in->data(), in->size());
+    bool ics = ICalendarReader::looksLike(data);
+    auto start = std::chrono::steady_clock::now();
+    long count = ics ? importTasks<ICalendarReader>(manager, data) : importTasks<TodoTxtReader>(manager, data);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!manager.save()) {
+        std::cerr << "Could not write " << tasksPath << ".\n";
+        return 1;
+    }
+    std::cout << "Imported " << count << " tasks from " << inPath << (ics ? " (iCalendar)" : " (todo.txt)")
+              << " into " << tasksPath << " (" << static_cast<long>(data.size() / 1048576.0 / std::max(seconds, 1e-6))
+              << " MB/s)\n";
+    return 0;
+}
+
+// Minimal FlatBuffers encoder, enough for Arrow's IPC metadata. Objects
+// are laid out front to back: a table or vector is written with its
+// offset fields blank, and link() fills one in once the child has been
+// placed after it (FlatBuffers offsets are unsigned, so they point forward).
+class FlatBuilder {
+    std::string buf;
+
+public:
+    // A table field of size 1, 2, 4 or 8 bytes; size 0 leaves the field out
+    // so it reads as its default. Offsets are 4-byte fields set by link().
+    struct Field {
+        uint8_t size;
+        uint64_t value = 0;
+    };
+
+    FlatBuilder() { append<uint32_t>(0); }  // root offset, set by finish()
+
+    template <typename T>
+    size_t append(T v) {
+        size_t at = buf.size();
+        buf.append(reinterpret_cast<const char*>(&v), sizeof v);
+        return at;
+    }
+
+    template <typename T>
+    void put(size_t at, T v) {
+        std::memcpy(&buf[at], &v, sizeof v);
+    }
+
+    void pad(size_t align) { buf.append((align - buf.size() % align) % align, '\0'); }
+
+    // A table and its vtable. Field i is at where[i], each aligned to its
+    // size; the table returned is what offsets to it should link to.
+    size_t table(std::initializer_list<Field> fields, size_t* where = nullptr) {
+        pad(2);
+        size_t vtable = buf.size();
+        size_t start = (vtable + 4 + 2 * fields.size() + 3) & ~size_t(3);
+        std::vector<uint16_t> offsets;
+        size_t end = start + 4;  // after the table's offset to its vtable
+        for (const Field& f : fields) {
+            if (f.size) end = (end + f.size - 1) / f.size * f.size;
+            offsets.push_back(f.size ? static_cast<uint16_t>(end - start) : 0);
+            end += f.size;
+        }
+        append<uint16_t>(static_cast<uint16_t>(4 + 2 * fields.size()));
+        append<uint16_t>(static_cast<uint16_t>(end - start));
+        for (uint16_t o : offsets) append<uint16_t>(o);
+        buf.resize(start, '\0');
+        append<int32_t>(static_cast<int32_t>(start - vtable));
+        size_t i = 0;
+        for (const Field& f : fields) {
+            if (where) where[i] = start + offsets[i];
+            if (f.size) buf.resize(start + offsets[i], '\0');
+            switch (f.size) {
+                case 1: append<uint8_t>(static_cast<uint8_t>(f.value)); break;
+                case 2: append<uint16_t>(static_cast<uint16_t>(f.value)); break;
+                case 4: append<uint32_t>(static_cast<uint32_t>(f.value)); break;
+                case 8: append<uint64_t>(f.value); break;
+            }
+            ++i;
+        }
+        return start;
+    }
+
+    // A vector of count zeroed elements, to fill in with put(); its
+    // elements start at the returned position + 4
+    size_t vector(size_t count, size_t elemSize, size_t align = 4) {
+        pad(4);
+        while ((buf.size() + 4) % align) append<uint32_t>(0);
+        size_t at = append<uint32_t>(static_cast<uint32_t>(count));
+        buf.append(count * elemSize, '\0');
+        return at;
+    }
+
+    size_t string(std::string_view s) {
+        pad(4);
+        size_t at = append<uint32_t>(static_cast<uint32_t>(s.size()));
+        buf += s;
+        buf += '\0';
+        return at;
+    }
+
+    void link(size_t field, size_t target) { put<uint32_t>(field, static_cast<uint32_t>(target - field)); }
+
+    // The finished buffer, padded to 8 bytes as Arrow wants its metadata
+    std::string_view finish(size_t root) {
+        link(0, root);
+        pad(8);
+        return buf;
+    }
+};
+
+// Writes a task list in Arrow's IPC format, as a random-access file or as
+// a stream, for analytics tools. The columns are id: int32, completed:
+// bool, title: utf8 and notes: utf8, none of them nullable. Each record
+// batch is filled straight from the snapshot's chunks into one buffer per
+// column, and the buffers are written as they are.
+class ArrowWriter {
+public:
+    struct Stats {
+        size_t rows = 0;
+        size_t batches = 0;
+        uint64_t bytes = 0;
+    };
+
+    static bool write(const TaskSnapshot& snap, const std::string& path, bool stream, Stats* stats = nullptr) {
+        std::string tmpPath = path + ".tmp";
+        ArrowWriter w;
+        w.out = std::fopen(tmpPath.c_str(), "wb");
+        if (!w.out) return false;
+        bool ok = w.writeAll(snap, stream);
+        ok = std::fclose(w.out) == 0 && ok;
+        if (ok && std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::remove(path.c_str());
+            ok = std::rename(tmpPath.c_str(), path.c_str()) == 0;
+        }
+        if (!ok) std::remove(tmpPath.c_str());
+        if (ok && stats) *stats = {w.rows, w.blocks.size(), w.offset};
+        return ok;
+    }
+
+private:
+    static constexpr size_t kBatchRows = 64 * 1024;
+    static constexpr size_t kBatchBytes = size_t(64) << 20;  // per string column, well inside int32 offsets
+    static constexpr char kMagic[] = "ARROW1";
+    static constexpr uint16_t kVersion = 4;  // MetadataVersion V5
+    // Union tags from Schema.fbs and Message.fbs
+    static constexpr uint8_t kTypeInt = 2, kTypeUtf8 = 5, kTypeBool = 6;
+    static constexpr uint8_t kHeaderSchema = 1, kHeaderRecordBatch = 3;
+
+    struct Block {
+        uint64_t offset;
+        uint32_t metadataLength;  // with its 8-byte prefix
+        uint64_t bodyLength;
+    };
+
+    std::FILE* out = nullptr;
+    uint64_t offset = 0;
+    bool ok = true;
+    std::vector<Block> blocks;
+    size_t rows = 0;
+
+    // The batch being filled
+    std::vector<int32_t> ids;
+    std::vector<uint8_t> completed;  // bitmap, least significant bit first
+    std::vector<int32_t> titleOffsets{0};
+    std::string titles;
+    std::vector<int32_t> noteOffsets{0};
+    std::string notes;
+
+    void writeBytes(const void* data, size_t n) {
+        if (n == 0) return;  // empty validity buffers have no data pointer
+        ok = ok && std::fwrite(data, 1, n, out) == n;
+        offset += n;
+    }
+
+    void pad8() {
+        static const char zeros[8] = {};
+        writeBytes(zeros, (8 - offset % 8) % 8);
+    }
+
+    static size_t addSchema(FlatBuilder& b) {
+        struct Column {
+            const char* name;
+            uint8_t type;
+        };
+        static const Column columns[] = {
+            {"id", kTypeInt}, {"completed", kTypeBool}, {"title", kTypeUtf8}, {"notes", kTypeUtf8}};
+        size_t at[2];
+        size_t schema = b.table({{0}, {4}}, at);  // endianness (little, the default), fields
+        size_t fields = b.vector(4, 4);
+        b.link(at[1], fields);
+        for (size_t i = 0; i < 4; ++i) {
+            // name, nullable, type_type, type, dictionary, children
+            size_t f[6];
+            b.link(fields + 4 + 4 * i, b.table({{4}, {1, 0}, {1, columns[i].type}, {4}, {0}, {4}}, f));
+            b.link(f[0], b.string(columns[i].name));
+            // Int is bitWidth and is_signed; Utf8 and Bool have no fields
+            b.link(f[3], columns[i].type == kTypeInt ? b.table({{4, 32}, {1, 1}}) : b.table({}));
+            b.link(f[5], b.vector(0, 4));
+        }
+        return schema;
+    }
+
+    // An encapsulated message: continuation marker, metadata length, the
+    // Message flatbuffer whose header addHeader writes, then the body
+    template <typename Fn>
+    Block writeMessage(uint8_t headerType, uint64_t bodyLength, Fn addHeader) {
+        FlatBuilder b;
+        size_t at[4];
+        // version, header_type, header, bodyLength
+        size_t message = b.table({{2, kVersion}, {1, headerType}, {4}, {8, bodyLength}}, at);
+        b.link(at[2], addHeader(b));
+        std::string_view meta = b.finish(message);
+        Block block{offset, static_cast<uint32_t>(8 + meta.size()), bodyLength};
+        uint32_t prefix[2] = {0xFFFFFFFFu, static_cast<uint32_t>(meta.size())};
+        writeBytes(prefix, sizeof prefix);
+        writeBytes(meta.data(), meta.size());
+        return block;
+    }
+
+    void flushBatch() {
+        size_t n = ids.size();
+        if (n == 0) return;
+        // Two buffers per column (validity, values) and a third (data) for
+        // strings. Nothing is null, so the validity buffers are empty.
+        const std::pair<const void*, size_t> buffers[] = {
+            {nullptr, 0}, {ids.data(), n * 4},
+            {nullptr, 0}, {completed.data(), completed.size()},
+            {nullptr, 0}, {titleOffsets.data(), (n + 1) * 4}, {titles.data(), titles.size()},
+            {nullptr, 0}, {noteOffsets.data(), (n + 1) * 4}, {notes.data(), notes.size()},
+        };
+        uint64_t bodyLength = 0;
+        for (const auto& buffer : buffers) bodyLength += (buffer.second + 7) / 8 * 8;
+        Block block = writeMessage(kHeaderRecordBatch, bodyLength, [&](FlatBuilder& b) {
+            size_t at[3];
+            size_t batch = b.table({{8, n}, {4}, {4}}, at);  // length, nodes, buffers
+            size_t nodes = b.vector(4, 16, 8);
+            for (size_t i = 0; i < 4; ++i) b.put<int64_t>(nodes + 4 + 16 * i, static_cast<int64_t>(n));
+            b.link(at[1], nodes);
+            size_t list = b.vector(std::size(buffers), 16, 8);
+            uint64_t pos = 0;
+            for (size_t i = 0; i < std::size(buffers); ++i) {
+                b.put<uint64_t>(list + 4 + 16 * i, pos);
+                b.put<uint64_t>(list + 12 + 16 * i, buffers[i].second);
+                pos += (buffers[i].second + 7) / 8 * 8;
+            }
+            b.link(at[2], list);
+            return batch;
+        });
+        for (const auto& buffer : buffers) {
+            writeBytes(buffer.first, buffer.second);
+            pad8();
+        }
+        blocks.push_back(block);
+        rows += n;
+        ids.clear();
+        completed.clear();
+        titleOffsets.resize(1);
+        titles.clear();
+        noteOffsets.resize(1);
+        notes.clear();
+    }
+
+    bool writeAll(const TaskSnapshot& snap, bool stream) {
+        if (!stream) writeBytes("ARROW1\0\0", 8);
+        writeMessage(kHeaderSchema, 0, addSchema);
+        ids.reserve(std::min(snap.size(), kBatchRows));
+        for (const Task& t : snap) {
+            size_t slot = ids.size();
+            if (slot % 8 == 0) completed.push_back(0);
+            if (t.isCompleted()) completed.back() |= static_cast<uint8_t>(1u << (slot % 8));
+            ids.push_back(t.getId());
+            titles += t.getTitle();
+            titleOffsets.push_back(static_cast<int32_t>(titles.size()));
+            notes += t.getNotes();
+            noteOffsets.push_back(static_cast<int32_t>(notes.size()));
+            if (ids.size() == kBatchRows || titles.size() >= kBatchBytes || notes.size() >= kBatchBytes) flushBatch();
+        }
+        flushBatch();
+        const uint32_t eos[2] = {0xFFFFFFFFu, 0};
+        writeBytes(eos, sizeof eos);
+        if (stream) return ok;
+
+        // The footer repeats the schema and says where each batch starts
+        FlatBuilder b;
+        size_t at[4];
+        size_t footer = b.table({{2, kVersion}, {4}, {4}, {4}}, at);  // version, schema, dictionaries, recordBatches
+        b.link(at[1], addSchema(b));
+        b.link(at[2], b.vector(0, 24, 8));
+        size_t list = b.vector(blocks.size(), 24, 8);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            b.put<uint64_t>(list + 4 + 24 * i, blocks[i].offset);
+            b.put<uint32_t>(list + 12 + 24 * i, blocks[i].metadataLength);
+            b.put<uint64_t>(list + 20 + 24 * i, blocks[i].bodyLength);
+        }
+        b.link(at[3], list);
+        std::string_view meta = b.finish(footer);
+        uint32_t length = static_cast<uint32_t>(meta.size());
+        writeBytes(meta.data(), meta.size());
+        writeBytes(&length, sizeof length);
+        writeBytes(kMagic, 6);
+        return ok;
+    }
+};
+
+// Write a task file out as Arrow, for analytics tools
+static int runExportArrow(const std::string& tasksPath, const std::string& outPath, bool stream) {
+    TaskManager manager(tasksPath);
+    manager.enableJournal();
+    if (!manager.load()) {
+        std::cerr << "Could not read " << tasksPath << ".\n";
+        return 1;
+    }
+    ArrowWriter::Stats stats;
+    auto start = std::chrono::steady_clock::now();
+    if (!ArrowWriter::write(manager.list(), outPath, stream, &stats)) {
+        std::cerr << "Could not write " << outPath << ".\n";
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << stats.rows << " tasks in " << stats.batches << " record batches to " << outPath
+              << " (" << stats.bytes / 1024 << " KB, "
+              << static_cast<long>(stats.bytes / 1048576.0 / std::max(seconds, 1e-6)) << " MB/s)\n";
+    return 0;
+}
+
+// SHA-256 (FIPS 180-4), for naming stored chunks by their content
+class Sha256 {
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    unsigned char block[64];
+    size_t used = 0;
+    uint64_t total = 0;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const unsigned char* p) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = uint32_t(p[4 * i]) << 24 | uint32_t(p[4 * i + 1]) << 16 | uint32_t(p[4 * i + 2]) << 8 | p[4 * i + 3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+public:
+    void update(std::string_view data) {
+        total += data.size();
+        for (unsigned char c : data) {
+            block[used++] = c;
+            if (used == 64) {
+                compress(block);
+                used = 0;
+            }
+        }
+    }
+
+    // Hex digest; the object is spent afterwards
+    std::string hex() {
+        uint64_t bits = total * 8;
+        unsigned char pad = 0x80;
+        update(std::string_view(reinterpret_cast<const char*>(&pad), 1));
+        while (used != 56) update(std::string_view("\0", 1));
+        for (int i = 7; i >= 0; --i) {
+            char byte = static_cast<char>(bits >> (8 * i));
+            update(std::string_view(&byte, 1));
+        }
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        for (uint32_t s : state) {
+            for (int shift = 28; shift >= 0; shift -= 4) out += digits[(s >> shift) & 0xF];
+        }
+        return out;
+    }
+
+    static std::string of(std::string_view data) {
+        Sha256 h;
+        h.update(data);
+        return h.hex();
+    }
+};
+
+// SnapshotStore keeps point-in-time copies of a task list (the task file,
+// its journal and blob files) in a content-addressed directory beside it,
+// TASKS.snapshots/. Files are cut into chunks at content-defined
+// boundaries: a gear rolling hash over the bytes marks a cut wherever its
+// low bits are zero, so an edit only moves the cuts around it and the
+// chunks before and after keep their names. Each chunk is stored once under
+// its SHA-256; a snapshot is just a manifest listing its files' chunks.
+class SnapshotStore {
+    std::string tasksPath;
+    std::filesystem::path root;
+
+    // Chunks are 1 KB to 64 KB, about 4 KB past the minimum on average
+    static constexpr size_t kMinChunk = 1 << 10;
+    static constexpr size_t kMaxChunk = 1 << 16;
+    static constexpr uint64_t kCutMask = 0xFFFull << 52;
+
+    // Random 64-bit values per byte, from a fixed seed so cuts are stable
+    static const uint64_t* gearTable() {
+        static const std::array<uint64_t, 256> table = [] {
+            std::array<uint64_t, 256> t{};
+            uint64_t x = 0;
+            for (auto& v : t) {
+                uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                v = z ^ (z >> 31);
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    // Length of the chunk that starts data. Each step shifts the hash, so
+    // its top bits depend on the last 64 bytes only.
+    static size_t cut(std::string_view data) {
+        if (data.size() <= kMinChunk) return data.size();
+        const uint64_t* gear = gearTable();
+        size_t end = std::min(data.size(), kMaxChunk);
+        uint64_t h = 0;
+        for (size_t i = kMinChunk; i < end; ++i) {
+            h = (h << 1) + gear[static_cast<unsigned char>(data[i])];
+            if ((h & kCutMask) == 0) return i + 1;
+        }
+        return end;
+    }
+
+    std::filesystem::path chunkPath(const std::string& hash) const {
+        return root / "chunks" / hash.substr(0, 2) / hash.substr(2);
+    }
+
+    std::filesystem::path manifestPath(const std::string& name) const { return root / "manifests" / name; }
+
+    // Write a file durably and atomically
+    static bool writeFile(const std::filesystem::path& path, std::string_view bytes) {
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+        std::string tmp = path.string() + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return false;
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size() && syncFile(f);
+        ok = std::fclose(f) == 0 && ok;
+        std::filesystem::rename(tmp, path, ec);
+        return ok && !ec;
+    }
+
+    static bool readFile(const std::filesystem::path& path, std::string& out) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) return false;
+        out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // The task file and everything saved beside it that a restore needs
+    std::vector<std::filesystem::path> listFiles() const {
+        std::filesystem::path tasks(tasksPath);
+        std::vector<std::filesystem::path> files{tasks};
+        std::string blobPrefix = tasks.filename().string() + ".blobs.";
+        std::filesystem::path dir = tasks.has_parent_path() ? tasks.parent_path() : ".";
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::string name = entry.path().filename().string();
+            if (name == tasks.filename().string() + ".journal" || name.rfind(blobPrefix, 0) == 0) {
+                files.push_back(tasks.has_parent_path() ? dir / name : std::filesystem::path(name));
+            }
+        }
+        return files;
+    }
+
+public:
+    struct Stats {
+        size_t files = 0;
+        size_t chunks = 0;
+        size_t newChunks = 0;
+        uint64_t bytes = 0;
+        uint64_t newBytes = 0;
+    };
+
+    explicit SnapshotStore(const std::string& tasks) : tasksPath(tasks), root(tasks + ".snapshots") {}
+
+    // Names become file names: letters, digits, '-', '_' and '.', not leading
+    static bool validName(const std::string& name) {
+        return !name.empty() && name[0] != '.' && std::all_of(name.begin(), name.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' || c == '.';
+        });
+    }
+
+    // Store the current files under name. Chunks already in the store are
+    // reused; the manifest is written last, so a failed snapshot leaves
+    // only unreferenced chunks behind.
+    bool take(const std::string& name, Stats& stats) {
+        if (!validName(name)) return false;
+        std::string manifest = "snapshot,1\n";
+        std::string bytes;
+        for (const auto& path : listFiles()) {
+            if (!readFile(path, bytes)) return false;
+            ++stats.files;
+            stats.bytes += bytes.size();
+            manifest += "file," + Task::quoteField(path.filename().string()) + "," + std::to_string(bytes.size())
+                      + "," + Sha256::of(bytes) + "\n";
+            std::string_view rest = bytes;
+            while (!rest.empty()) {
+                std::string_view chunk = rest.substr(0, cut(rest));
+                rest.remove_prefix(chunk.size());
+                std::string hash = Sha256::of(chunk);
+                ++stats.chunks;
+                std::error_code ec;
+                if (!std::filesystem::exists(chunkPath(hash), ec)) {
+                    if (!writeFile(chunkPath(hash), chunk)) return false;
+                    ++stats.newChunks;
+                    stats.newBytes += chunk.size();
+                }
+                manifest += "chunk," + hash + "," + std::to_string(chunk.size()) + "\n";
+            }
+        }
+        return writeFile(manifestPath(name), manifest);
+    }
+
+    // Put the files of a snapshot back, checking every chunk's hash first.
+    // Journal and blob files the snapshot did not have are removed, so
+    // nothing newer gets replayed over it.
+    bool restore(const std::string& name) {
+        struct Entry {
+            std::string name;
+            std::string hash;
+            std::string contents;
+        };
+        std::string manifest;
+        if (!validName(name) || !readFile(manifestPath(name), manifest)) return false;
+        std::istringstream in(manifest);
+        std::string line;
+        if (!std::getline(in, line) || line != "snapshot,1") return false;
+        std::vector<Entry> files;
+        std::string chunk;
+        std::string scratch;
+        while (std::getline(in, line)) {
+            std::string_view f[3];
+            if (line.rfind("file,", 0) == 0 && Task::splitQuoted(std::string_view(line).substr(5), f, 3)) {
+                files.push_back(Entry{std::string(Task::unquoteField(f[0], scratch)), std::string(f[2]), {}});
+            } else if (line.rfind("chunk,", 0) == 0 && !files.empty()
+                       && Task::splitFields(std::string_view(line).substr(6), f, 2)) {
+                std::string hash(f[0]);
+                if (!readFile(chunkPath(hash), chunk) || Sha256::of(chunk) != hash) return false;
+                files.back().contents += chunk;
+            } else {
+                return false;
+            }
+        }
+        std::set<std::string> names;
+        for (const auto& e : files) {
+            if (Sha256::of(e.contents) != e.hash) return false;
+            names.insert(e.name);
+        }
+        for (const auto& path : listFiles()) {
+            if (!names.count(path.filename().string())) std::remove(path.string().c_str());
+        }
+        std::filesystem::path dir = std::filesystem::path(tasksPath).parent_path();
+        for (const auto& e : files) {
+            if (!writeFile(dir / e.name, e.contents)) return false;
+        }
+        return true;
+    }
+
+    // Snapshot names, oldest first
+    std::vector<std::string> list() const {
+        std::vector<std::pair<std::filesystem::file_time_type, std::string>> found;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(root / "manifests", ec)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) continue;
+            found.emplace_back(std::filesystem::last_write_time(entry.path(), ec), name);
+        }
+        std::sort(found.begin(), found.end());
+        std::vector<std::string> names;
+        for (auto& f : found) names.push_back(std::move(f.second));
+        return names;
+    }
+};
+
+// Point-in-time backups of a task list (see SnapshotStore)
+static int runSnapshot(const std::string& tasksPath, std::string name) {
+    if (name.empty()) {
+        std::time_t now = std::time(nullptr);
+        char stamp[32];
+        std::strftime(stamp, sizeof stamp, "%Y%m%d-%H%M%S", std::localtime(&now));
+        name = stamp;
+    }
+    SnapshotStore store(tasksPath);
+    SnapshotStore::Stats stats;
+    if (!store.take(name, stats)) {
+        std::cerr << "Could not write snapshot " << name << ".\n";
+        return 1;
+    }
+    std::cout << "Snapshot " << name << ": " << stats.files << " files, " << stats.bytes << " bytes in "
+              << stats.chunks << " chunks; " << stats.newChunks << " new chunks (" << stats.newBytes
+              << " bytes) stored\n";
+    return 0;
+}
+
+static int runRestore(const std::string& tasksPath, const std::string& name) {
+    if (!SnapshotStore(tasksPath).restore(name)) {
+        std::cerr << "Could not restore snapshot " << name << ".\n";
+        return 1;
+    }
+    std::cout << "Restored " << tasksPath << " from snapshot " << name << "\n";
+    return 0;
+}
+
+static int runListSnapshots(const std::string& tasksPath) {
+    for (const auto& name : SnapshotStore(tasksPath).list()) std::cout << name << "\n";
+    return 0;
+}
+
+// Input helpers
+static int readInt(const std::string& prompt) {
+    while (true) {
+        std::cout << prompt;
+        int value;
+        if (std::cin >> value) {
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            return value;
+        }
+        std::cout << "Invalid number. Try again.\n";
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+}
+
+static std::string readLine(const std::string& prompt) {
+    std::cout << prompt;
+    std::string s;
+    std::getline(std::cin, s);
+    return std::string(trim(s));
+}
+
+// Pretty printing
+static void printTaskHeader() {
+    std::cout << "\n"
+              << std::left << std::setw(6) << "ID"
+              << std::left << std::setw(12) << "Status"
+              << std::left << std::setw(30) << "Title"
+              << "Notes\n";
+    std::cout << std::string(75, '=') << "\n";
+}
+
+static void printTaskRow(const Task& t) {
+    std::cout << std::left << std::setw(6) << t.getId()
+              << std::left << std::setw(12) << (t.isCompleted() ? "Complete" : "Open")
+              << std::left << std::setw(30) << t.getTitle()
+              << t.getNotes() << "\n";
+}
+
+// Print the list, or only the tasks in `only` (sorted ids) when given
+static void printTasks(const TaskSnapshot& tasks, const std::vector<int>* only = nullptr) {
+    auto shown = [&](const Task& t) {
+        return !only || std::binary_search(only->begin(), only->end(), t.getId());
+    };
+    if (tasks.empty() || (only && only->empty())) {
+        std::cout << "No tasks found.\n";
+        return;
+    }
+    printTaskHeader();
+    for (const auto& t : tasks) {
+        if (shown(t)) printTaskRow(t);
+    }
+    std::cout << "\n";
+}
+
+// List the versions kept this session, then show one of them if asked
+static void printHistory(const TaskHistory& history) {
+    for (const auto& v : history.all()) {
+        std::time_t when = TaskHistory::Clock::to_time_t(v.committedAt);
+        char stamp[32];
+        std::strftime(stamp, sizeof stamp, "%Y-%m-%d %H:%M:%S", std::localtime(&when));
+        std::cout << std::right << std::setw(4) << v.number << "  " << stamp << "  " << std::left << std::setw(8)
+                  << v.tag << std::right << " " << v.tasks.size() << " tasks\n";
+    }
+    std::string pick = readLine("Show version (number or tag, blank to skip): ");
+    if (pick.empty()) return;
+    int number = 0;
+    const TaskHistory::Version* v = parseInt(pick, number) ? history.byNumber(number) : history.byTag(pick);
+    if (!v) {
+        std::cout << "No such version.\n\n";
+        return;
+    }
+    if (v->tasks.empty()) {
+        std::cout << "No tasks found.\n\n";
+        return;
+    }
+    printTaskHeader();
+    for (const Task* t : v->tasks.sorted()) printTaskRow(*t);
+    std::cout << "\n";
+}
+
+// Print tasks in the order of the given ids
+static void printTasksInOrder(const TaskSnapshot& tasks, const std::vector<int>& order) {
+    if (tasks.empty()) {
+        std::cout << "No tasks found.\n";
+        return;
+    }
+    std::unordered_map<int, const Task*> byId;
+    for (const auto& t : tasks) byId[t.getId()] = &t;
+    printTaskHeader();
+    for (int id : order) {
+        auto it = byId.find(id);
+        if (it != byId.end()) printTaskRow(*it->second);
+    }
+    std::cout << "\n";
+}
+
+static void printIndexStatus(const char* name, const TaskManager::IndexStatus& s) {
+    std::cout << std::left << std::setw(14) << name;
+    if (s.ready && s.bytes) {
+        std::cout << "ready, " << s.bytes << " bytes (" << s.plainBytes << " with plain id lists)\n";
+    } else if (s.ready) {
+        std::cout << "ready\n";
+    } else if (s.building) {
+        std::cout << "building (" << static_cast<int>(s.progress * 100) << "%)\n";
+    } else {
+        std::cout << "not built\n";
+    }
+}
+
+static void printStats(TaskManager& manager) {
+    TaskSnapshot tasks = manager.list();
+    size_t done = 0;
+    for (const auto& t : tasks) done += t.isCompleted() ? 1 : 0;
+    std::cout << "Tasks: " << tasks.size() << " (" << tasks.size() - done << " open, "
+              << done << " complete)\n";
+    std::cout << "Indexes (searches scan until ready):\n";
+    printIndexStatus("  Title words", manager.titleIndexStatus());
+    printIndexStatus("  Title order", manager.titleOrderStatus());
+    TaskManager::BlobStats blobs = manager.blobStats();
+    std::cout << "Notes out of line: " << blobs.outOfLine << " (" << blobs.liveBytes << " of "
+              << blobs.fileBytes << " blob file bytes in use)\n";
+    const QueryCache& cache = manager.queryCacheStats();
+    std::cout << "Query cache: " << cache.size() << " results, " << cache.bytes() << "/"
+              << cache.limit() << " bytes, " << cache.hitCount() << " hits, "
+              << cache.missCount() << " misses, " << cache.evictionCount() << " evictions\n";
+    std::cout << "\n";
+}
+
+static void printMenu() {
+    std::cout << "=============================\n";
+    std::cout << "       To Do List Menu       \n";
+    std::cout << "=============================\n";
+    std::cout << "1. List tasks\n";
+    std::cout << "2. Add task\n";
+    std::cout << "3. Toggle complete\n";
     std::cout << "4. Edit task\n";
     std::cout << "5. Remove task\n";
     std::cout << "6. Clear all tasks\n";
     std::cout << "7. Save\n";
     std::cout << "8. Load\n";
     std::cout << "9. Exit\n";
+    std::cout << "10. Search\n";
+    std::cout << "11. List by title\n";
+    std::cout << "12. Stats\n";
+    std::cout << "13. History\n";
+}
+
+// PageFile reads and writes fixed-size pages of a binary task file in place
+class PageFile {
+    int fd = -1;
+    uint32_t pages = 0;
+
+public:
+    static constexpr size_t kPageSize = 4096;
+
+    PageFile() = default;
+    PageFile(const PageFile&) = delete;
+    PageFile& operator=(const PageFile&) = delete;
+    ~PageFile() { close(); }
+
+    bool open(const std::string& path, bool writable, bool create) {
+        close();
+#ifdef _WIN32
+        int flags = (writable ? _O_RDWR : _O_RDONLY) | _O_BINARY | (create ? _O_CREAT | _O_TRUNC : 0);
+        fd = ::_open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+        if (fd < 0) return false;
+        long long size = _lseeki64(fd, 0, SEEK_END);
+#else
+        int flags = (writable ? O_RDWR : O_RDONLY) | (create ? O_CREAT | O_TRUNC : 0);
+        fd = ::open(path.c_str(), flags, 0644);
+        if (fd < 0) return false;
+        struct stat st;
+        long long size = fstat(fd, &st) == 0 ? static_cast<long long>(st.st_size) : -1;
+#endif
+        if (size < 0 || size % kPageSize != 0) {
+            close();
+            return false;
+        }
+        pages = static_cast<uint32_t>(size / kPageSize);
+        return true;
+    }
+
+    void close() {
+        if (fd < 0) return;
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    uint32_t pageCount() const { return pages; }
+    // A page number past the end; it is on disk once first written
+    uint32_t allocate() { return pages++; }
+
+    // Read pages first..first+bufs.size()-1, one buffer each, in one call
+    bool read(uint32_t first, const std::vector<char*>& bufs) {
+#ifdef _WIN32
+        if (_lseeki64(fd, static_cast<long long>(first) * kPageSize, SEEK_SET) < 0) return false;
+        for (char* buf : bufs) {
+            if (::_read(fd, buf, static_cast<unsigned>(kPageSize)) != static_cast<int>(kPageSize)) return false;
+        }
+        return true;
+#else
+        std::vector<iovec> iov(bufs.size());
+        for (size_t i = 0; i < bufs.size(); ++i) iov[i] = {bufs[i], kPageSize};
+        off_t at = static_cast<off_t>(first) * static_cast<off_t>(kPageSize);
+        size_t done = 0;
+        while (done < iov.size()) {
+            int n = static_cast<int>(std::min<size_t>(iov.size() - done, IOV_MAX));
+            ssize_t got = preadv(fd, iov.data() + done, n, at);
+            if (got < 0 && errno == EINTR) continue;
+            // Pages past the end of the file were allocated but not written
+            if (got <= 0 || got % static_cast<ssize_t>(kPageSize) != 0) return false;
+            done += static_cast<size_t>(got) / kPageSize;
+            at += got;
+        }
+        return true;
+#endif
+    }
+
+    bool write(uint32_t page, const char* buf) {
+#ifdef _WIN32
+        return _lseeki64(fd, static_cast<long long>(page) * kPageSize, SEEK_SET) >= 0
+            && ::_write(fd, buf, static_cast<unsigned>(kPageSize)) == static_cast<int>(kPageSize);
+#else
+        off_t at = static_cast<off_t>(page) * static_cast<off_t>(kPageSize);
+        size_t done = 0;
+        while (done < kPageSize) {
+            ssize_t n = pwrite(fd, buf + done, kPageSize - done, at + static_cast<off_t>(done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+#endif
+    }
+
+    bool sync() {
+#ifdef _WIN32
+        return _commit(fd) == 0;
+#else
+        return fsync(fd) == 0;
+#endif
+    }
+};
+
+// BufferPool holds a fixed number of pages of a PageFile. Callers pin a
+// page for as long as they use it (PageRef) and get mutableData() to change
+// it; changed pages are written back when evicted or on flush(). Eviction
+// is CLOCK: the hand skips pinned frames and clears the referenced bit of
+// recently used ones, taking the first frame it finds clear. A sequential
+// fetch that misses also reads the following pages in the same call; those
+// come in unreferenced, so they are the first to go if nobody uses them.
+class BufferPool {
+    static constexpr uint32_t kNoPage = UINT32_MAX;
+
+    struct Frame {
+        uint32_t page = kNoPage;
+        uint32_t pins = 0;
+        bool referenced = false;
+        bool dirty = false;
+    };
+
+public:
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t reads = 0;      // read calls
+        size_t readAhead = 0;  // pages read before they were asked for
+        size_t writes = 0;
+        size_t evictions = 0;
+    };
+
+    // A pinned page; unpinned when the PageRef goes away
+    class PageRef {
+        BufferPool* pool = nullptr;
+        size_t frame = 0;
+
+    public:
+        PageRef() = default;
+        PageRef(BufferPool* p, size_t f) : pool(p), frame(f) {}
+        PageRef(PageRef&& o) noexcept : pool(o.pool), frame(o.frame) { o.pool = nullptr; }
+        PageRef& operator=(PageRef&& o) noexcept {
+            if (this != &o) {
+                release();
+                pool = o.pool;
+                frame = o.frame;
+                o.pool = nullptr;
+            }
+            return *this;
+        }
+        ~PageRef() { release(); }
+
+        void release() {
+            if (pool) --pool->frames[frame].pins;
+            pool = nullptr;
+        }
+
+        explicit operator bool() const { return pool != nullptr; }
+        uint32_t page() const { return pool->frames[frame].page; }
+        const char* data() const { return pool->frameData(frame); }
+        char* mutableData() {
+            pool->frames[frame].dirty = true;
+            return pool->frameData(frame);
+        }
+    };
+
+    BufferPool(PageFile& f, size_t frameCount, size_t readAhead = 8)
+        : file(f), frames(std::max<size_t>(frameCount, 4)),
+          memory(frames.size() * PageFile::kPageSize),
+          readAheadPages(std::min(readAhead, frames.size() / 4)) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Pin a page, reading it in if needed. Empty if the page does not
+    // exist, every frame is pinned, or I/O fails.
+    PageRef fetch(uint32_t page, bool sequential = false) {
+        auto it = table.find(page);
+        if (it != table.end()) {
+            ++stats.hits;
+            Frame& fr = frames[it->second];
+            ++fr.pins;
+            fr.referenced = true;
+            return PageRef(this, it->second);
+        }
+        if (page >= file.pageCount()) return {};
+        ++stats.misses;
+        uint32_t count = 1;
+        if (sequential) {
+            while (count <= readAheadPages && page + count < file.pageCount() && !table.count(page + count)) ++count;
+        }
+        // Victims are pinned as they are taken so none is handed out twice
+        std::vector<size_t> got;
+        std::vector<char*> bufs;
+        for (uint32_t i = 0; i < count; ++i) {
+            std::optional<size_t> v = victim();
+            if (!v) break;
+            frames[*v].pins = 1;
+            got.push_back(*v);
+            bufs.push_back(frameData(*v));
+        }
+        bool ok = !got.empty() && file.read(page, bufs);
+        if (ok) ++stats.reads;
+        for (size_t i = 0; i < got.size(); ++i) {
+            Frame& fr = frames[got[i]];
+            fr.pins = ok && i == 0 ? 1 : 0;
+            if (!ok) continue;
+            fr.page = page + static_cast<uint32_t>(i);
+            fr.referenced = i == 0;
+            fr.dirty = false;
+            table[fr.page] = got[i];
+        }
+        if (!ok) return {};
+        stats.readAhead += got.size() - 1;
+        return PageRef(this, got[0]);
+    }
+
+    // Pin a new zeroed page at the end of the file
+    PageRef create() {
+        std::optional<size_t> v = victim();
+        if (!v) return {};
+        Frame& fr = frames[*v];
+        fr.page = file.allocate();
+        fr.pins = 1;
+        fr.referenced = true;
+        fr.dirty = true;
+        std::memset(frameData(*v), 0, PageFile::kPageSize);
+        table[fr.page] = *v;
+        return PageRef(this, *v);
+    }
+
+    // Write back every changed page, in page order, and sync the file
+    bool flush() {
+        std::vector<std::pair<uint32_t, size_t>> dirty;
+        for (size_t f = 0; f < frames.size(); ++f) {
+            if (frames[f].dirty) dirty.emplace_back(frames[f].page, f);
+        }
+        std::sort(dirty.begin(), dirty.end());
+        for (const auto& d : dirty) {
+            if (!writeBack(d.second)) return false;
+        }
+        return file.sync();
+    }
+
+    size_t frameCount() const { return frames.size(); }
+    const Stats& statistics() const { return stats; }
+
+private:
+    PageFile& file;
+    std::vector<Frame> frames;
+    std::vector<char> memory;
+    size_t readAheadPages;
+    std::unordered_map<uint32_t, size_t> table;  // page -> frame
+    size_t hand = 0;
+    Stats stats;
+
+    char* frameData(size_t f) { return memory.data() + f * PageFile::kPageSize; }
+
+    bool writeBack(size_t f) {
+        if (!file.write(frames[f].page, frameData(f))) return false;
+        frames[f].dirty = false;
+        ++stats.writes;
+        return true;
+    }
+
+    // Two sweeps clear every referenced bit, so finding nothing means
+    // every frame is pinned
+    std::optional<size_t> victim() {
+        for (size_t step = 0; step < 2 * frames.size(); ++step) {
+            size_t f = hand;
+            hand = (hand + 1) % frames.size();
+            Frame& fr = frames[f];
+            if (fr.pins) continue;
+            if (fr.referenced) {
+                fr.referenced = false;
+                continue;
+            }
+            if (fr.page != kNoPage) {
+                if (fr.dirty && !writeBack(f)) return std::nullopt;
+                table.erase(fr.page);
+                fr.page = kNoPage;
+                ++stats.evictions;
+            }
+            return f;
+        }
+        return std::nullopt;
+    }
+};
+
+// PagedTaskStore is the binary task format: a header page, then slotted
+// data pages and the pages of a B+tree mapping ids to records. A data page
+// has a slot directory after its header and packs records from the end of
+// the page down; removing a record zeroes its slot and the space is
+// reclaimed when the page is compacted, so record ids (page, slot) stay
+// put. Records over kMaxInline bytes keep their title and notes in a chain
+// of overflow pages. Everything goes through a BufferPool, so memory use is
+// the pool size however many tasks the file holds, and adding, finding or
+// removing one task touches O(log n) pages. Changes are not journaled:
+// write a new file and rename it over the old one where a torn update
+// matters.
+class PagedTaskStore {
+public:
+    struct RecordId {
+        uint32_t page = 0;
+        uint16_t slot = 0;
+    };
+
+    static constexpr size_t kPageSize = PageFile::kPageSize;
+
+    // Create an empty store at path, replacing any file there
+    static std::unique_ptr<PagedTaskStore> create(const std::string& path, size_t poolPages) {
+        auto store = std::unique_ptr<PagedTaskStore>(new PagedTaskStore(poolPages));
+        if (!store->file.open(path, true, true)) return nullptr;
+        BufferPool::PageRef head = store->pool.create();
+        if (!head) return nullptr;
+        std::memcpy(store->header.magic, kMagic, sizeof(kMagic));
+        store->header.pageSize = kPageSize;
+        head.release();
+        store->headerDirty = true;
+        return store;
+    }
+
+    static std::unique_ptr<PagedTaskStore> open(const std::string& path, size_t poolPages, bool writable) {
+        auto store = std::unique_ptr<PagedTaskStore>(new PagedTaskStore(poolPages));
+        if (!store->file.open(path, writable, false)) return nullptr;
+        BufferPool::PageRef head = store->pool.fetch(0);
+        if (!head) return nullptr;
+        std::memcpy(&store->header, head.data(), sizeof(Header));
+        if (std::memcmp(store->header.magic, kMagic, sizeof(kMagic)) != 0 || store->header.pageSize != kPageSize) {
+            return nullptr;
+        }
+        store->bulk.reset();
+        return store;
+    }
+
+    // Whether path starts like a file written by PagedTaskStore
+    static bool isPagedFile(const std::string& path) {
+        char magic[sizeof(kMagic)] = {};
+        std::ifstream in(path, std::ios::binary);
+        return in.read(magic, sizeof(magic)) && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+    }
+
+    PagedTaskStore(const PagedTaskStore&) = delete;
+    PagedTaskStore& operator=(const PagedTaskStore&) = delete;
+    ~PagedTaskStore() { flush(); }
+
+    uint64_t size() const { return header.records; }
+    int maxId() const { return header.maxId; }
+    uint32_t pageCount() const { return file.pageCount(); }
+    const BufferPool::Stats& poolStats() const { return pool.statistics(); }
+
+    // False if the id is already there
+    bool add(const Task& t) {
+        RecordId where;
+        if (!finishBulk() || indexFind(t.getId(), where)) return false;
+        return insertRecord(t, where) && indexInsert(t.getId(), where);
+    }
+
+    // Add tasks to a new store in ascending id order: the index is built
+    // bottom-up as they come instead of one insert at a time. Anything out
+    // of order (or after another call) goes through add().
+    bool append(const Task& t) {
+        if (!bulk || (bulk->count && t.getId() <= bulk->lastId)) return add(t);
+        RecordId where;
+        return insertRecord(t, where) && bulk->add(t.getId(), where);
+    }
+
+    bool get(int id, Task& out) {
+        RecordId where;
+        return finishBulk() && indexFind(id, where) && readRecord(where, out);
+    }
+
+    // Replace the task with t's id; false if there is none
+    bool update(const Task& t) {
+        RecordId where, moved;
+        if (!finishBulk() || !indexFind(t.getId(), where)) return false;
+        return removeRecord(where) && insertRecord(t, moved) && indexInsert(t.getId(), moved);
+    }
+
+    bool removeById(int id) {
+        RecordId where;
+        if (!finishBulk() || !indexFind(id, where)) return false;
+        return removeRecord(where) && indexErase(id);
+    }
+
+    // Visit every record in file order with fn(RecordId, const Task&).
+    // One Task is reused throughout, so the scan allocates only while
+    // titles and notes keep getting longer.
+    template <typename Fn>
+    bool scan(Fn fn) {
+        Task t;
+        for (uint32_t pg = 1; pg < file.pageCount(); ++pg) {
+            BufferPool::PageRef page = pool.fetch(pg, true);
+            if (!page) return false;
+            PageHeader ph = pageHeader(page.data());
+            if (ph.kind != kDataPage) continue;
+            for (uint16_t s = 0; s < ph.slots; ++s) {
+                Slot slot = slotAt(page.data(), s);
+                if (slot.offset == 0) continue;
+                if (!decode(page.data() + slot.offset, t)) return false;
+                fn(RecordId{pg, s}, static_cast<const Task&>(t));
+            }
+        }
+        return true;
+    }
+
+    // Visit the tasks with ids in [lo, hi] in id order, following the
+    // leaf chain of the index
+    template <typename Fn>
+    bool scanRange(int lo, int hi, Fn fn) {
+        if (!finishBulk()) return false;
+        if (!header.indexRoot || lo > hi) return true;
+        Task t;
+        BufferPool::PageRef leaf = findLeaf(lo);
+        while (leaf) {
+            const char* p = leaf.data();
+            PageHeader ph = pageHeader(p);
+            for (uint16_t i = lowerBound(p, ph.slots, lo); i < ph.slots; ++i) {
+                LeafEntry e = leafEntry(p, i);
+                if (e.id > hi) return true;
+                if (!readRecord({e.page, e.slot}, t)) return false;
+                fn(static_cast<const Task&>(t));
+            }
+            if (!ph.next) return true;
+            leaf = pool.fetch(ph.next);
+        }
+        return false;
+    }
+
+    bool flush() {
+        if (!finishBulk()) return false;
+        if (headerDirty) {
+            BufferPool::PageRef head = pool.fetch(0);
+            if (!head) return false;
+            std::memcpy(head.mutableData(), &header, sizeof(header));
+            headerDirty = false;
+        }
+        return pool.flush();
+    }
+
+private:
+    static constexpr char kMagic[8] = {'T', 'O', 'D', 'O', 'P', 'G', '0', '1'};
+    static constexpr uint32_t kDataPage = 1;
+    static constexpr uint32_t kOverflowPage = 2;
+    static constexpr uint32_t kFreePage = 3;
+    static constexpr uint32_t kLeafPage = 4;
+    static constexpr uint32_t kInnerPage = 5;
+    static constexpr size_t kMaxInline = kPageSize / 4;
+
+    struct Header {
+        char magic[8];
+        uint32_t pageSize;
+        uint32_t freeHead;    // first page of the free list, 0 if none
+        uint64_t records;
+        uint32_t insertPage;  // data page new records go to, 0 if none
+        int32_t maxId;
+        uint32_t indexRoot;   // root of the id index, 0 while empty
+        uint32_t roomHead;    // first data page listed as having room, 0 if none
+    };
+
+    // kind and next are shared by every page type
+    struct PageHeader {
+        uint32_t kind;
+        uint32_t next;       // overflow and free pages: the next in the chain;
+                             // leaves: the leaf to the right; data pages:
+                             // the next page with room
+        uint16_t slots;      // data pages: slots; index pages: entries
+        uint16_t heapStart;  // data pages: start of the record area
+        uint32_t used;       // overflow pages: payload bytes; data pages: 1
+                             // while on the list of pages with room
+    };
+
+    struct Slot {
+        uint16_t offset;  // 0 for a removed record
+        uint16_t length;
+    };
+
+    struct RecordHeader {
+        int32_t id;
+        uint8_t completed;
+        uint8_t overflow;  // title and notes are in the chain at firstOverflow
+        uint16_t reserved;
+        uint32_t titleLen;
+        uint32_t notesLen;
+        uint32_t firstOverflow;
+    };
+
+    // Leaves hold sorted (id, record) entries. Inner nodes hold n sorted
+    // keys and n + 1 children; child i covers ids from key i - 1 up to
+    // but not including key i.
+    struct LeafEntry {
+        int32_t id;
+        uint32_t page;
+        uint16_t slot;
+        uint16_t reserved;
+    };
+
+    struct InnerEntry {
+        int32_t key;
+        uint32_t child;  // covers ids from key on
+    };
+
+    static constexpr size_t kPayload = kPageSize - sizeof(PageHeader);
+    static constexpr size_t kLeafCapacity = kPayload / sizeof(LeafEntry);
+    static constexpr size_t kInnerCapacity = (kPayload - sizeof(uint32_t)) / sizeof(InnerEntry);
+
+    // Builds the index bottom-up from ids in ascending order. Leaves are
+    // filled and written as entries come, keeping one separator per leaf
+    // for the levels above. Pages are packed full: ids only grow, so later
+    // adds land in the last leaf and do not split the others.
+    struct BulkLoad {
+        PagedTaskStore& store;
+        BufferPool::PageRef leaf;
+        std::vector<InnerEntry> level;  // first id and page of each node
+        size_t count = 0;
+        int lastId = 0;
+
+        explicit BulkLoad(PagedTaskStore& s) : store(s) {}
+
+        bool add(int id, RecordId where) {
+            if (!leaf || pageHeader(leaf.data()).slots == kLeafCapacity) {
+                BufferPool::PageRef next = store.allocate(kLeafPage);
+                if (!next) return false;
+                if (leaf) setNext(leaf, next.page());
+                leaf = std::move(next);
+                level.push_back({id, leaf.page()});
+            }
+            char* p = leaf.mutableData();
+            PageHeader ph = pageHeader(p);
+            setLeafEntry(p, ph.slots++, {id, where.page, where.slot, 0});
+            std::memcpy(p, &ph, sizeof(ph));
+            ++count;
+            lastId = id;
+            return true;
+        }
+
+        bool finish() {
+            leaf.release();
+            while (level.size() > 1) {
+                std::vector<InnerEntry> up;
+                for (size_t i = 0; i < level.size(); i += kInnerCapacity + 1) {
+                    size_t end = std::min(level.size(), i + kInnerCapacity + 1);
+                    BufferPool::PageRef node = store.allocate(kInnerPage);
+                    if (!node) return false;
+                    char* p = node.mutableData();
+                    setChild0(p, level[i].child);
+                    PageHeader ph = pageHeader(p);
+                    for (size_t j = i + 1; j < end; ++j) setInnerEntry(p, ph.slots++, level[j]);
+                    std::memcpy(p, &ph, sizeof(ph));
+                    up.push_back({level[i].key, node.page()});
+                }
+                level = std::move(up);
+            }
+            if (!level.empty()) store.header.indexRoot = level[0].child;
+            store.headerDirty = true;
+            return true;
+        }
+    };
+
+    struct Split {
+        bool happened = false;
+        int key = 0;         // first id of the new right node
+        uint32_t right = 0;
+    };
+
+    PageFile file;
+    BufferPool pool;
+    Header header{};
+    bool headerDirty = false;
+    std::string scratch;  // overflow records being read
+    std::unique_ptr<BulkLoad> bulk;
+
+    explicit PagedTaskStore(size_t poolPages) : pool(file, poolPages), bulk(std::make_unique<BulkLoad>(*this)) {}
+
+    bool finishBulk() {
+        if (!bulk) return true;
+        std::unique_ptr<BulkLoad> done = std::move(bulk);
+        // A store opened from disk may already have an index
+        return done->count == 0 || done->finish();
+    }
+
+    static PageHeader pageHeader(const char* p) {
+        PageHeader ph;
+        std::memcpy(&ph, p, sizeof(ph));
+        return ph;
+    }
+
+    static void setNext(BufferPool::PageRef& page, uint32_t next) {
+        PageHeader ph = pageHeader(page.data());
+        ph.next = next;
+        std::memcpy(page.mutableData(), &ph, sizeof(ph));
+    }
+
+    static Slot slotAt(const char* p, uint16_t s) {
+        Slot slot;
+        std::memcpy(&slot, p + sizeof(PageHeader) + s * sizeof(Slot), sizeof(slot));
+        return slot;
+    }
+
+    static void setSlot(char* p, uint16_t s, Slot slot) {
+        std::memcpy(p + sizeof(PageHeader) + s * sizeof(Slot), &slot, sizeof(slot));
+    }
+
+    static LeafEntry leafEntry(const char* p, size_t i) {
+        LeafEntry e;
+        std::memcpy(&e, p + sizeof(PageHeader) + i * sizeof(LeafEntry), sizeof(e));
+        return e;
+    }
+
+    static void setLeafEntry(char* p, size_t i, const LeafEntry& e) {
+        std::memcpy(p + sizeof(PageHeader) + i * sizeof(LeafEntry), &e, sizeof(e));
+    }
+
+    static uint32_t child0(const char* p) {
+        uint32_t c;
+        std::memcpy(&c, p + sizeof(PageHeader), sizeof(c));
+        return c;
+    }
+
+    static void setChild0(char* p, uint32_t c) { std::memcpy(p + sizeof(PageHeader), &c, sizeof(c)); }
+
+    static InnerEntry innerEntry(const char* p, size_t i) {
+        InnerEntry e;
+        std::memcpy(&e, p + sizeof(PageHeader) + sizeof(uint32_t) + i * sizeof(InnerEntry), sizeof(e));
+        return e;
+    }
+
+    static void setInnerEntry(char* p, size_t i, const InnerEntry& e) {
+        std::memcpy(p + sizeof(PageHeader) + sizeof(uint32_t) + i * sizeof(InnerEntry), &e, sizeof(e));
+    }
+
+    // First leaf entry with an id not below id
+    static uint16_t lowerBound(const char* p, uint16_t n, int id) {
+        uint16_t lo = 0, hi = n;
+        while (lo < hi) {
+            uint16_t mid = static_cast<uint16_t>((lo + hi) / 2);
+            if (leafEntry(p, mid).id < id) lo = static_cast<uint16_t>(mid + 1);
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Child of an inner node that covers id
+    static uint32_t childFor(const char* p, uint16_t n, int id) {
+        uint16_t lo = 0, hi = n;
+        while (lo < hi) {
+            uint16_t mid = static_cast<uint16_t>((lo + hi) / 2);
+            if (innerEntry(p, mid).key <= id) lo = static_cast<uint16_t>(mid + 1);
+            else hi = mid;
+        }
+        return lo == 0 ? child0(p) : innerEntry(p, lo - 1).child;
+    }
+
+    // The leaf that holds id or would; parents are unpinned on the way
+    // down, so a lookup needs only one frame at a time
+    BufferPool::PageRef findLeaf(int id) {
+        BufferPool::PageRef page = pool.fetch(header.indexRoot);
+        while (page) {
+            PageHeader ph = pageHeader(page.data());
+            if (ph.kind == kLeafPage) return page;
+            if (ph.kind != kInnerPage) return {};
+            page = pool.fetch(childFor(page.data(), ph.slots, id));
+        }
+        return {};
+    }
+
+    bool indexFind(int id, RecordId& out) {
+        if (!header.indexRoot) return false;
+        BufferPool::PageRef leaf = findLeaf(id);
+        if (!leaf) return false;
+        PageHeader ph = pageHeader(leaf.data());
+        uint16_t i = lowerBound(leaf.data(), ph.slots, id);
+        if (i == ph.slots || leafEntry(leaf.data(), i).id != id) return false;
+        LeafEntry e = leafEntry(leaf.data(), i);
+        out = {e.page, e.slot};
+        return true;
+    }
+
+    // Insert or repoint id; a split of the root grows the tree by a level
+    bool indexInsert(int id, RecordId where) {
+        if (!header.indexRoot) {
+            BufferPool::PageRef leaf = allocate(kLeafPage);
+            if (!leaf) return false;
+            header.indexRoot = leaf.page();
+        }
+        Split split;
+        if (!insertInto(header.indexRoot, id, where, split)) return false;
+        if (split.happened) {
+            BufferPool::PageRef root = allocate(kInnerPage);
+            if (!root) return false;
+            char* p = root.mutableData();
+            setChild0(p, header.indexRoot);
+            setInnerEntry(p, 0, {split.key, split.right});
+            PageHeader ph = pageHeader(p);
+            ph.slots = 1;
+            std::memcpy(p, &ph, sizeof(ph));
+            header.indexRoot = root.page();
+        }
+        headerDirty = true;
+        return true;
+    }
+
+    // Insert below pg. If pg had to split, its new right sibling and the
+    // separator for the parent come back in up. The node is unpinned while
+    // its child is worked on, so a deep tree does not pin a whole path.
+    // rightEdge says pg is the last node of its level.
+    bool insertInto(uint32_t pg, int id, RecordId where, Split& up, bool rightEdge = true) {
+        BufferPool::PageRef page = pool.fetch(pg);
+        if (!page) return false;
+        PageHeader ph = pageHeader(page.data());
+        if (ph.kind == kLeafPage) {
+            uint16_t i = lowerBound(page.data(), ph.slots, id);
+            LeafEntry entry{id, where.page, where.slot, 0};
+            if (i < ph.slots && leafEntry(page.data(), i).id == id) {
+                setLeafEntry(page.mutableData(), i, entry);
+                return true;
+            }
+            std::vector<LeafEntry> all(ph.slots + 1u);
+            for (uint16_t j = 0; j < ph.slots; ++j) all[j < i ? j : j + 1] = leafEntry(page.data(), j);
+            all[i] = entry;
+            // New ids come in ascending order, so an add past the end of
+            // the last leaf starts a new leaf and leaves this one full
+            bool append = rightEdge && i == ph.slots;
+            size_t keep = all.size() <= kLeafCapacity ? all.size() : append ? all.size() - 1 : all.size() / 2;
+            if (keep < all.size()) {
+                BufferPool::PageRef right = allocate(kLeafPage);
+                if (!right) return false;
+                char* r = right.mutableData();
+                PageHeader rh = pageHeader(r);
+                rh.slots = static_cast<uint16_t>(all.size() - keep);
+                rh.next = ph.next;
+                for (size_t j = keep; j < all.size(); ++j) setLeafEntry(r, j - keep, all[j]);
+                std::memcpy(r, &rh, sizeof(rh));
+                ph.next = right.page();
+                up = {true, all[keep].id, right.page()};
+            }
+            char* p = page.mutableData();
+            for (size_t j = 0; j < keep; ++j) setLeafEntry(p, j, all[j]);
+            ph.slots = static_cast<uint16_t>(keep);
+            std::memcpy(p, &ph, sizeof(ph));
+            return true;
+        }
+        if (ph.kind != kInnerPage) return false;
+
+        uint32_t child = childFor(page.data(), ph.slots, id);
+        bool lastChild = ph.slots == 0 || innerEntry(page.data(), ph.slots - 1).key <= id;
+        page.release();
+        Split below;
+        if (!insertInto(child, id, where, below, rightEdge && lastChild)) return false;
+        if (!below.happened) return true;
+
+        page = pool.fetch(pg);
+        if (!page) return false;
+        std::vector<InnerEntry> all(ph.slots + 1u);
+        uint16_t i = 0;
+        while (i < ph.slots && innerEntry(page.data(), i).key < below.key) ++i;
+        for (uint16_t j = 0; j < ph.slots; ++j) all[j < i ? j : j + 1] = innerEntry(page.data(), j);
+        all[i] = {below.key, below.right};
+        // Likewise at the right edge of the tree only the new child moves
+        size_t keep = all.size() <= kInnerCapacity ? all.size()
+                      : rightEdge && i == ph.slots ? all.size() - 1
+                                                   : all.size() / 2;
+        if (keep < all.size()) {
+            // The middle key moves up; its child starts the right node
+            BufferPool::PageRef right = allocate(kInnerPage);
+            if (!right) return false;
+            char* r = right.mutableData();
+            setChild0(r, all[keep].child);
+            PageHeader rh = pageHeader(r);
+            rh.slots = static_cast<uint16_t>(all.size() - keep - 1);
+            for (size_t j = keep + 1; j < all.size(); ++j) setInnerEntry(r, j - keep - 1, all[j]);
+            std::memcpy(r, &rh, sizeof(rh));
+            up = {true, all[keep].key, right.page()};
+        }
+        char* p = page.mutableData();
+        for (size_t j = 0; j < keep; ++j) setInnerEntry(p, j, all[j]);
+        ph.slots = static_cast<uint16_t>(keep);
+        std::memcpy(p, &ph, sizeof(ph));
+        return true;
+    }
+
+    // Removes the entry in place. Underfull nodes are not merged (an
+    // emptied leaf stays in the chain); repacking the file rebuilds the
+    // index full.
+    bool indexErase(int id) {
+        if (!header.indexRoot) return false;
+        BufferPool::PageRef leaf = findLeaf(id);
+        if (!leaf) return false;
+        PageHeader ph = pageHeader(leaf.data());
+        uint16_t i = lowerBound(leaf.data(), ph.slots, id);
+        if (i == ph.slots || leafEntry(leaf.data(), i).id != id) return false;
+        char* p = leaf.mutableData();
+        std::memmove(p + sizeof(PageHeader) + i * sizeof(LeafEntry),
+                     p + sizeof(PageHeader) + (i + 1) * sizeof(LeafEntry),
+                     (ph.slots - i - 1) * sizeof(LeafEntry));
+        --ph.slots;
+        std::memcpy(p, &ph, sizeof(ph));
+        return true;
+    }
+
+    bool insertRecord(const Task& t, RecordId& where) {
+        std::string_view title = t.getTitle();
+        std::string_view notes = t.getNotes();
+        RecordHeader rec{};
+        rec.id = t.getId();
+        rec.completed = t.isCompleted();
+        rec.titleLen = static_cast<uint32_t>(title.size());
+        rec.notesLen = static_cast<uint32_t>(notes.size());
+        size_t len = sizeof(RecordHeader) + title.size() + notes.size();
+        if (len > kMaxInline) {
+            rec.overflow = 1;
+            if (!writeOverflow(title, notes, rec.firstOverflow)) return false;
+            len = sizeof(RecordHeader);
+        }
+
+        BufferPool::PageRef page;
+        if (header.insertPage) {
+            page = pool.fetch(header.insertPage);
+            if (!page) return false;
+            if (!fits(page.data(), len) && !compact(page, len)) page.release();
+        }
+        if (!page) page = takeRoomyPage(len);
+        if (!page) {
+            page = allocate(kDataPage);
+            if (!page) return false;
+            header.insertPage = page.page();
+        }
+
+        char* p = page.mutableData();
+        PageHeader ph = pageHeader(p);
+        uint16_t slot = ph.slots;
+        for (uint16_t s = 0; s < ph.slots; ++s) {
+            if (slotAt(p, s).offset == 0) {
+                slot = s;
+                break;
+            }
+        }
+        if (slot == ph.slots) ++ph.slots;
+        ph.heapStart = static_cast<uint16_t>(ph.heapStart - len);
+        std::memcpy(p + ph.heapStart, &rec, sizeof(rec));
+        if (!rec.overflow) {
+            std::memcpy(p + ph.heapStart + sizeof(rec), title.data(), title.size());
+            std::memcpy(p + ph.heapStart + sizeof(rec) + title.size(), notes.data(), notes.size());
+        }
+        setSlot(p, slot, {ph.heapStart, static_cast<uint16_t>(len)});
+        std::memcpy(p, &ph, sizeof(ph));
+
+        ++header.records;
+        header.maxId = std::max(header.maxId, t.getId());
+        headerDirty = true;
+        where = {page.page(), slot};
+        return true;
+    }
+
+    bool removeRecord(RecordId where) {
+        BufferPool::PageRef page = fetchData(where.page);
+        if (!page) return false;
+        PageHeader ph = pageHeader(page.data());
+        if (where.slot >= ph.slots) return false;
+        Slot s = slotAt(page.data(), where.slot);
+        if (s.offset == 0) return false;
+        RecordHeader rec;
+        std::memcpy(&rec, page.data() + s.offset, sizeof(rec));
+        if (rec.overflow && !freeChain(rec.firstOverflow)) return false;
+
+        char* p = page.mutableData();
+        setSlot(p, where.slot, {0, 0});
+        while (ph.slots > 0 && slotAt(p, ph.slots - 1).offset == 0) --ph.slots;
+        --header.records;
+        headerDirty = true;
+        if (where.page == header.insertPage || ph.used) {
+            std::memcpy(p, &ph, sizeof(ph));
+        } else if (ph.slots == 0) {
+            release(page);
+        } else {
+            // Once any record would fit again, list the page so that
+            // inserts fill it before the file grows
+            std::memcpy(p, &ph, sizeof(ph));
+            if (freeBytes(p) >= kMaxInline + sizeof(Slot)) {
+                ph.used = 1;
+                ph.next = header.roomHead;
+                header.roomHead = where.page;
+                std::memcpy(p, &ph, sizeof(ph));
+            }
+        }
+        return true;
+    }
+
+    // Bytes a compaction would leave for records and their slots
+    static size_t freeBytes(const char* p) {
+        PageHeader ph = pageHeader(p);
+        size_t live = 0;
+        for (uint16_t s = 0; s < ph.slots; ++s) live += slotAt(p, s).length;
+        return kPageSize - sizeof(PageHeader) - ph.slots * sizeof(Slot) - live;
+    }
+
+    // Take pages off the list of pages with room until one holds len more
+    // bytes, and make it the insert page. Empty if the list runs out.
+    BufferPool::PageRef takeRoomyPage(size_t len) {
+        while (header.roomHead) {
+            BufferPool::PageRef page = fetchData(header.roomHead);
+            if (!page) return {};
+            PageHeader ph = pageHeader(page.data());
+            header.roomHead = ph.next;
+            headerDirty = true;
+            ph.next = 0;
+            ph.used = 0;
+            std::memcpy(page.mutableData(), &ph, sizeof(ph));
+            if (fits(page.data(), len) || compact(page, len)) {
+                header.insertPage = page.page();
+                return page;
+            }
+        }
+        return {};
+    }
+
+    bool readRecord(RecordId where, Task& out) {
+        BufferPool::PageRef page = fetchData(where.page);
+        if (!page) return false;
+        PageHeader ph = pageHeader(page.data());
+        if (where.slot >= ph.slots) return false;
+        Slot s = slotAt(page.data(), where.slot);
+        return s.offset != 0 && decode(page.data() + s.offset, out);
+    }
+
+    // Room for len more bytes and, unless a slot is free, one more slot
+    static bool fits(const char* p, size_t len) {
+        PageHeader ph = pageHeader(p);
+        size_t need = len + sizeof(Slot);
+        for (uint16_t s = 0; s < ph.slots; ++s) {
+            if (slotAt(p, s).offset == 0) {
+                need = len;
+                break;
+            }
+        }
+        size_t directoryEnd = sizeof(PageHeader) + ph.slots * sizeof(Slot);
+        return ph.heapStart >= directoryEnd && ph.heapStart - directoryEnd >= need;
+    }
+
+    // Pack the live records against the end of the page, keeping slot
+    // numbers; false (page untouched) if len would still not fit
+    bool compact(BufferPool::PageRef& page, size_t len) {
+        const char* p = page.data();
+        PageHeader ph = pageHeader(p);
+        size_t live = 0;
+        for (uint16_t s = 0; s < ph.slots; ++s) live += slotAt(p, s).length;
+        if (kPageSize - live == ph.heapStart) return false;  // nothing to reclaim
+        char packed[kPageSize];
+        std::memcpy(packed, p, kPageSize);
+        uint16_t top = static_cast<uint16_t>(kPageSize);
+        for (uint16_t s = 0; s < ph.slots; ++s) {
+            Slot slot = slotAt(p, s);
+            if (slot.offset == 0) continue;
+            top = static_cast<uint16_t>(top - slot.length);
+            std::memcpy(packed + top, p + slot.offset, slot.length);
+            setSlot(packed, s, {top, slot.length});
+        }
+        ph.heapStart = top;
+        std::memcpy(packed, &ph, sizeof(ph));
+        if (!fits(packed, len)) return false;
+        std::memcpy(page.mutableData(), packed, kPageSize);
+        return true;
+    }
+
+    BufferPool::PageRef fetchData(uint32_t pg) {
+        if (pg == 0) return {};
+        BufferPool::PageRef page = pool.fetch(pg);
+        if (page && pageHeader(page.data()).kind != kDataPage) return {};
+        return page;
+    }
+
+    // A page from the free list, or a new one at the end
+    BufferPool::PageRef allocate(uint32_t kind) {
+        BufferPool::PageRef page;
+        if (header.freeHead) {
+            page = pool.fetch(header.freeHead);
+            if (!page) return {};
+            header.freeHead = pageHeader(page.data()).next;
+        } else {
+            page = pool.create();
+            if (!page) return {};
+        }
+        headerDirty = true;
+        char* p = page.mutableData();
+        std::memset(p, 0, kPageSize);
+        PageHeader ph{};
+        ph.kind = kind;
+        ph.heapStart = static_cast<uint16_t>(kPageSize);
+        std::memcpy(p, &ph, sizeof(ph));
+        return page;
+    }
+
+    void release(BufferPool::PageRef& page) {
+        PageHeader ph{};
+        ph.kind = kFreePage;
+        ph.next = header.freeHead;
+        std::memcpy(page.mutableData(), &ph, sizeof(ph));
+        header.freeHead = page.page();
+        headerDirty = true;
+    }
+
+    bool writeOverflow(std::string_view title, std::string_view notes, uint32_t& first) {
+        std::string_view parts[2] = {title, notes};
+        size_t part = 0;
+        size_t at = 0;
+        BufferPool::PageRef prev;
+        first = 0;
+        do {
+            BufferPool::PageRef page = allocate(kOverflowPage);
+            if (!page) return false;
+            char* p = page.mutableData();
+            PageHeader ph = pageHeader(p);
+            while (part < 2 && ph.used < kPayload) {
+                size_t n = std::min(kPayload - ph.used, parts[part].size() - at);
+                std::memcpy(p + sizeof(PageHeader) + ph.used, parts[part].data() + at, n);
+                ph.used += static_cast<uint32_t>(n);
+                at += n;
+                if (at == parts[part].size()) {
+                    ++part;
+                    at = 0;
+                }
+            }
+            std::memcpy(p, &ph, sizeof(ph));
+            if (prev) {
+                setNext(prev, page.page());
+            } else {
+                first = page.page();
+            }
+            prev = std::move(page);
+        } while (part < 2);
+        return true;
+    }
+
+    bool freeChain(uint32_t pg) {
+        while (pg) {
+            BufferPool::PageRef page = pool.fetch(pg);
+            if (!page || pageHeader(page.data()).kind != kOverflowPage) return false;
+            uint32_t next = pageHeader(page.data()).next;
+            release(page);
+            pg = next;
+        }
+        return true;
+    }
+
+    bool decode(const char* at, Task& out) {
+        RecordHeader rec;
+        std::memcpy(&rec, at, sizeof(rec));
+        out.setId(rec.id);
+        out.setCompleted(rec.completed != 0);
+        if (!rec.overflow) {
+            out.setTitle(std::string_view(at + sizeof(rec), rec.titleLen));
+            out.setNotes(std::string_view(at + sizeof(rec) + rec.titleLen, rec.notesLen));
+            return true;
+        }
+        scratch.clear();
+        for (uint32_t pg = rec.firstOverflow; pg;) {
+            BufferPool::PageRef page = pool.fetch(pg);
+            if (!page) return false;
+            PageHeader ph = pageHeader(page.data());
+            if (ph.kind != kOverflowPage || ph.used > kPayload) return false;
+            scratch.append(page.data() + sizeof(PageHeader), ph.used);
+            pg = ph.next;
+        }
+        if (scratch.size() != size_t(rec.titleLen) + rec.notesLen) return false;
+        out.setTitle(std::string_view(scratch).substr(0, rec.titleLen));
+        out.setNotes(std::string_view(scratch).substr(rec.titleLen));
+        return true;
+    }
+};
+
+// Convert a task file to the paged binary format. A paged file as input
+// is repacked: records and index are rebuilt full, in id order.
+static int runPack(const std::string& inPath, const std::string& outPath) {
+    std::unique_ptr<PagedTaskStore> paged;
+    std::optional<TaskFileReader> in;
+    if (PagedTaskStore::isPagedFile(inPath)) paged = PagedTaskStore::open(inPath, 64, false);
+    else in.emplace(inPath);
+    if (paged ? !paged : !in->isOpen()) {
+        std::cerr << "Could not read " << inPath << ".\n";
+        return 1;
+    }
+    const std::string tmp = outPath + ".tmp";
+    size_t count = 0;
+    size_t duplicates = 0;
+    uint32_t pages = 0;
+    bool ok = false;
+    {
+        auto store = PagedTaskStore::create(tmp, 256);
+        if (store) {
+            ok = true;
+            Task existing;
+            auto add = [&](const Task& t) {
+                if (!ok) return;
+                if (store->append(t)) {
+                    ++count;
+                } else if (store->get(t.getId(), existing)) {
+                    ++duplicates;  // the first record of an id wins
+                } else {
+                    ok = false;
+                }
+            };
+            if (paged) {
+                ok = paged->scanRange(std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), add) && ok;
+            } else {
+                Task t;
+                while (ok && in->next(t)) add(t);
+            }
+            ok = ok && store->flush();
+            pages = store->pageCount();
+        }
+    }
+    paged.reset();  // the input may be the output
+    if (!ok || std::rename(tmp.c_str(), outPath.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        std::cerr << "Could not write " << outPath << ".\n";
+        return 1;
+    }
+    std::cout << "Packed " << count << " tasks into " << outPath << " (" << pages << " pages)";
+    if (duplicates) std::cout << ", skipped " << duplicates << " repeated ids";
+    std::cout << "\n";
+    return 0;
+}
+
+// Change one task of a paged file in place: add, toggle or remove it
+// through the index, touching only the pages on its path
+static int runPagedEdit(const std::string& path, const std::string& op, const std::string& arg,
+                        const std::string& notes) {
+    auto store = PagedTaskStore::open(path, 64, true);
+    if (!store) {
+        std::cerr << "Could not open " << path << " (convert task files with todo pack).\n";
+        return 1;
+    }
+    int id = 0;
+    Task t;
+    bool found = true;
+    bool ok = true;
+    if (op == "add") {
+        if (store->maxId() == std::numeric_limits<int>::max()) {
+            std::cerr << "No ids left in " << path << ".\n";
+            return 1;
+        }
+        id = std::max(store->maxId(), 0) + 1;
+        ok = store->add(Task(id, arg, notes, false));
+    } else if (!parseInt(arg, id)) {
+        std::cerr << "Not a task id: " << arg << "\n";
+        return 2;
+    } else if (op == "toggle") {
+        found = store->get(id, t);
+        t.setCompleted(!t.isCompleted());
+        ok = !found || store->update(t);
+    } else {
+        found = store->removeById(id);
+    }
+    ok = ok && store->flush();
+    if (!ok) {
+        std::cerr << "Could not write " << path << ".\n";
+        return 1;
+    }
+    if (!found) {
+        std::cout << "Task not found.\n";
+        return 1;
+    }
+    const BufferPool::Stats& s = store->poolStats();
+    std::cout << (op == "add" ? "Added" : op == "toggle" ? "Toggled" : "Removed") << " task " << id << " ("
+              << s.misses << " pages read, " << s.writes << " written of " << store->pageCount() << ")\n";
+    return 0;
+}
+
+// Print the tasks of a paged file with ids from lo to hi, found through
+// its index
+static int runShow(const std::string& path, int lo, int hi) {
+    auto store = PagedTaskStore::open(path, 64, false);
+    if (!store) {
+        std::cerr << "Could not open " << path << " (convert task files with todo pack).\n";
+        return 1;
+    }
+    size_t shown = 0;
+    bool ok = store->scanRange(lo, hi, [&](const Task& t) {
+        if (shown++ == 0) printTaskHeader();
+        printTaskRow(t);
+    });
+    if (!ok) {
+        std::cerr << "Could not read " << path << ".\n";
+        return 1;
+    }
+    std::cout << (shown ? "\n" : "No tasks found.\n");
+    return 0;
+}
+
+// Filter a paged task file through a buffer pool of poolPages pages
+static int runQuery(const std::string& path, const std::string& text, size_t poolPages) {
+    auto store = PagedTaskStore::open(path, poolPages, false);
+    if (!store) {
+        std::cerr << "Could not open " << path << " (convert task files with todo pack).\n";
+        return 1;
+    }
+    TaskQuery q = TaskQuery::parse(text);
+    size_t shown = 0;
+    bool ok = store->scan([&](PagedTaskStore::RecordId, const Task& t) {
+        if (!q.matches(t)) return;
+        if (shown++ == 0) printTaskHeader();
+        printTaskRow(t);
+    });
+    if (!ok) {
+        std::cerr << "Could not read " << path << ".\n";
+        return 1;
+    }
+    const BufferPool::Stats& s = store->poolStats();
+    std::cout << (shown ? "\n" : "No tasks found.\n") << shown << " of " << store->size() << " tasks matched; "
+              << s.reads << " reads (" << s.misses + s.readAhead << " pages) into "
+              << poolPages << " buffer pages, " << s.evictions << " evictions\n";
+    return 0;
+}
+
+// Apply a script of edits to the lists of a Workspace, one edit per line:
+//   LIST add TITLE | LIST toggle ID | LIST remove ID
+// Blank lines and lines starting with # are skipped. Lines that cannot
+// be applied are reported to errors and counted in the result.
+static size_t applyScript(Workspace& ws, std::istream& in, std::ostream& errors) {
+    std::string line;
+    size_t lineNo = 0, failed = 0;
+    while (std::getline(in, line)) {
+        ++lineNo;
+        std::string_view rest = trim(line);
+        if (rest.empty() || rest[0] == '#') continue;
+        auto word = [&rest] {
+            size_t end = std::min(rest.find_first_of(" \t"), rest.size());
+            std::string_view w = rest.substr(0, end);
+            rest = trim(rest.substr(end));
+            return w;
+        };
+        std::string list(word());
+        std::string_view op = word();
+        // A list is a file in the workspace directory, never outside it
+        if (list.find_first_of("/\\") != std::string::npos || list[0] == '.') op = {};
+        int id = 0;
+        bool ok = false;
+        if (op == "add" && !rest.empty()) {
+            ok = ws.open(list)->addTask(rest, "") > 0;
+        } else if (op == "toggle" && parseInt(rest, id)) {
+            ok = ws.open(list)->toggleComplete(id);
+        } else if (op == "remove" && parseInt(rest, id)) {
+            ok = ws.open(list)->removeById(id);
+        }
+        if (!ok) {
+            errors << "Line " << lineNo << ": could not apply \"" << trim(line) << "\".\n";
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+// Run an edit script over the lists in dir, keeping at most about
+// memoryMB of them loaded at once
+static int runApply(const std::string& dir, const std::string& scriptPath, size_t memoryMB) {
+    if (!std::filesystem::is_directory(dir)) {
+        std::cerr << dir << " is not a directory.\n";
+        return 1;
+    }
+    std::ifstream file;
+    if (scriptPath != "-") {
+        file.open(scriptPath);
+        if (!file) {
+            std::cerr << "Could not open " << scriptPath << ".\n";
+            return 1;
+        }
+    }
+    Workspace ws(dir, memoryMB << 20);
+    size_t failed = applyScript(ws, scriptPath == "-" ? std::cin : file, std::cerr);
+    if (!ws.flushAll()) {
+        std::cerr << "Could not save every list in " << dir << ".\n";
+        return 1;
+    }
+    std::cout << ws.loadCount() << " list loads, " << ws.hitCount() << " hits, " << ws.evictionCount()
+              << " evictions\n";
+    return failed ? 1 : 0;
+}
+
+// Built-in regression checks, run by `todo selftest [NAME]`. Each check
+// works in a scratch directory of its own and returns what went wrong,
+// or an empty string when all is well.
+static std::string checkLoadById(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    {
+        TaskManager m(path);
+        for (int i = 1; i <= 5; ++i) m.addTask("task " + std::to_string(i), "");
+        if (!m.save()) return "save failed";
+    }
+    for (bool journaled : {false, true}) {
+        std::string how = journaled ? " (journaled load)" : "";
+        TaskManager m(path);
+        if (journaled) m.enableJournal();
+        if (!m.load()) return "load failed" + how;
+        for (int id = 1; id <= 5; ++id) {
+            if (!m.find(id)) return "task " + std::to_string(id) + " not found after load" + how;
+        }
+        if (!m.toggleComplete(2) || !m.find(2)->isCompleted()) return "toggle after load failed" + how;
+        if (!m.editTask(3, "renamed", "") || m.find(3)->getTitle() != "renamed") return "edit after load failed" + how;
+        if (!m.removeById(4) || m.find(4)) return "remove after load failed" + how;
+        if (m.addTask("new", "") != 6 || !m.find(6)) return "add after load failed" + how;
+    }
+    return "";
+}
+
+static std::string titlesOf(const std::string& path) {
+    TaskManager m(path);
+    m.load();
+    std::vector<std::string> titles;
+    for (const auto& t : m.list()) titles.emplace_back(t.getTitle());
+    std::sort(titles.begin(), titles.end());
+    std::string out;
+    for (const auto& t : titles) out += (out.empty() ? "" : ",") + t;
+    return out;
+}
+
+// Importing the same delta twice must not duplicate tasks
+static std::string checkSyncReimport(const std::filesystem::path& dir) {
+    std::string a = (dir / "a.csv").string(), b = (dir / "b.csv").string();
+    std::string delta = (dir / "delta").string();
+    {
+        TaskManager m(a);
+        m.addTask("one", "");
+        m.addTask("two", "");
+        if (!m.save()) return "save failed";
+    }
+    if (!syncExport(a, "b", delta)) return "export failed";
+    for (int round = 1; round <= 2; ++round) {
+        if (syncImport(b, delta) < 0) return "import failed";
+        if (titlesOf(b) != "one,two") return "after import " + std::to_string(round) + ": " + titlesOf(b);
+    }
+    return "";
+}
+
+// Removing the task with the highest id and adding one after a restart
+// must give the new task an id of its own, not the removed task's
+// identity: otherwise a peer removing the old task takes the new one too
+static std::string checkSyncIdReuse(const std::filesystem::path& dir) {
+    std::string a = (dir / "a.csv").string(), b = (dir / "b.csv").string();
+    std::string toB = (dir / "to-b").string(), toA = (dir / "to-a").string();
+    {
+        TaskManager m(a);
+        m.addTask("one", "");
+        m.addTask("two", "");
+        if (!m.save()) return "save failed";
+    }
+    if (!syncExport(a, "b", toB) || syncImport(b, toB) < 0) return "first sync failed";
+    {
+        TaskManager m(a);
+        m.load();
+        m.removeById(2);
+        if (!m.save()) return "save failed";
+    }
+    int id = 0;
+    {
+        TaskManager m(a);
+        m.load();
+        id = m.addTask("three", "");
+        if (!m.save()) return "save failed";
+    }
+    if (id == 2) return "id 2 was handed out again";
+    {
+        TaskManager m(b);
+        m.load();
+        for (const auto& t : m.list()) {
+            if (t.getTitle() == "two") m.removeById(t.getId());
+        }
+        if (!m.save()) return "save failed";
+    }
+    if (!syncExport(b, "a", toA) || syncImport(a, toA) < 0) return "second sync failed";
+    if (titlesOf(a) != "one,three") return "a has " + titlesOf(a);
+    if (!syncExport(a, "b", toB) || syncImport(b, toB) < 0) return "third sync failed";
+    if (titlesOf(b) != "one,three") return "b has " + titlesOf(b);
+    return "";
+}
+
+// A delta that never arrives must not lose changes: the next delta still
+// carries them until the peer acknowledges one it imported whole, and only
+// then do later deltas shrink to the newer changes
+static std::string checkSyncLostDelta(const std::filesystem::path& dir) {
+    std::string a = (dir / "a.csv").string(), b = (dir / "b.csv").string();
+    std::string toB = (dir / "to-b").string(), toA = (dir / "to-a").string();
+    auto addTo = [](const std::string& path, const std::string& title) {
+        TaskManager m(path);
+        m.load();
+        m.addTask(title, "");
+        return m.save();
+    };
+    auto entriesIn = [](const std::string& path) {
+        std::ifstream in(path);
+        int n = 0;
+        for (std::string line; std::getline(in, line);) n += line.rfind("t,", 0) == 0;
+        return n;
+    };
+    if (!addTo(a, "one") || !syncExport(a, "b", toB)) return "first export failed";
+    if (!addTo(a, "two") || !syncExport(a, "b", toB)) return "second export failed";
+    if (syncImport(b, toB) < 0) return "import failed";
+    if (titlesOf(b) != "one,two") return "after a lost delta b has " + titlesOf(b);
+    if (!syncExport(b, "a", toA) || syncImport(a, toA) < 0) return "sync back failed";
+    if (!syncExport(a, "b", toB)) return "export failed";
+    if (entriesIn(toB) != 0) return "acknowledged tasks sent again";
+    // A delta cut short is imported as far as it goes but not acknowledged
+    if (!addTo(a, "three") || !syncExport(a, "b", toB)) return "export failed";
+    std::string text;
+    {
+        std::ifstream in(toB);
+        for (std::string line; std::getline(in, line);) {
+            if (line.rfind("end,", 0) != 0) text += line + "\n";
+        }
+    }
+    std::ofstream(toB, std::ios::trunc) << text;
+    if (syncImport(b, toB) < 0 || titlesOf(b) != "one,three,two") return "cut delta not imported";
+    if (!syncExport(b, "a", toA) || syncImport(a, toA) < 0 || !syncExport(a, "b", toB)) return "sync failed";
+    if (entriesIn(toB) != 1) return "cut delta was acknowledged";
+    return "";
+}
+
+// A 3-way merge takes each field from the side that changed it, keeps a
+// task one side deleted only if the other edited it, and reports both
+// sides changing one field; unsorted input must merge the same. Diff
+// lists what changed between base and one side.
+static std::string checkMerge(const std::filesystem::path& dir) {
+    std::string base = (dir / "base.csv").string(), ours = (dir / "ours.csv").string();
+    std::string theirs = (dir / "theirs.csv").string(), out = (dir / "out.csv").string();
+    {
+        TaskManager m(base);
+        for (const char* title : {"one", "two", "three", "four", "five", "six"}) m.addTask(title, "");
+        if (!m.save()) return "save failed";
+    }
+    auto edit = [&](const std::string& path, auto fn) {
+        std::filesystem::copy_file(base, path, std::filesystem::copy_options::overwrite_existing);
+        TaskManager m(path);
+        m.load();
+        fn(m);
+        return m.save();
+    };
+    bool saved = edit(ours, [](TaskManager& m) {
+        m.editTask(2, "two ours", "");
+        m.removeById(4);
+        m.editTask(5, "five ours", "");
+        m.editTask(6, "six ours", "");
+        m.putTask(8, "eight", "", false);
+    });
+    saved = saved && edit(theirs, [](TaskManager& m) {
+        m.editTask(2, "", "notes theirs");
+        m.toggleComplete(3);
+        m.removeById(5);
+        m.editTask(6, "six theirs", "");
+        m.putTask(7, "seven", "", false);
+    });
+    if (!saved) return "save failed";
+    auto contents = [](const std::string& path) {
+        TaskManager m(path);
+        m.load();
+        std::string s;
+        for (const auto& t : m.list()) {
+            s += std::to_string(t.getId()) + ":" + std::string(t.getTitle()) + "|" + std::string(t.getNotes()) +
+                 (t.isCompleted() ? "|x " : "| ");
+        }
+        return s;
+    };
+    const std::string expected =
+        "1:one|| 2:two ours|notes theirs| 3:three||x 5:five ours|| 6:six ours|| 7:seven|| 8:eight|| ";
+    MergeStats stats;
+    if (!mergeTaskFiles(&base, ours, theirs, out, stats)) return "merge failed";
+    if (contents(out) != expected) return "merged " + contents(out);
+    if (stats.conflicts.size() != 2) return std::to_string(stats.conflicts.size()) + " conflicts, expected 2";
+
+    // Out of id order: the join falls back to hashing every file
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(theirs);
+        for (std::string line; std::getline(in, line);) lines.push_back(line);
+    }
+    {
+        std::ofstream reversed(theirs, std::ios::trunc);
+        for (auto it = lines.rbegin(); it != lines.rend(); ++it) reversed << *it << "\n";
+    }
+    if (!mergeTaskFiles(&base, ours, theirs, out, stats) || contents(out) != expected) {
+        return "unsorted input merged " + contents(out);
+    }
+
+    std::vector<std::string> report;
+    if (!diffTaskFiles(base, ours, report, stats)) return "diff failed";
+    std::string diff;
+    for (const auto& line : report) diff += line + "\n";
+    if (diff != "~ 2 \"two ours\": title\n- 4 \"four\"\n~ 5 \"five ours\": title\n~ 6 \"six ours\": title\n"
+                "+ 8 \"eight\"\n" || stats.unchanged != 2) {
+        return "diff gave " + diff;
+    }
+    return "";
+}
+
+// Saves gather each chunk's cached lines, so after any mix of edits, with
+// snapshots still holding the chunks, the file must read exactly as the
+// tasks encoded afresh, and a held snapshot must still save its own state.
+// Gather writes span more parts than one writev takes.
+static std::string checkLineCache(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    auto encode = [](const TaskSnapshot& snap) {
+        std::string s;
+        for (const auto& t : snap) s += t.toCsv() + "\n";
+        return s;
+    };
+    auto read = [](const std::string& p) {
+        std::ifstream in(p, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    TaskManager m(path);
+    for (int i = 0; i < 3000; ++i) m.addTask("task " + std::to_string(i) + (i % 9 ? "" : ", \"quoted\""), "");
+    std::mt19937 rng(11);
+    for (int round = 0; round < 8; ++round) {
+        if (!m.save()) return "save failed";
+        if (read(path) != encode(m.list())) return "round " + std::to_string(round) + ": file differs from the tasks";
+        TaskSnapshot held = m.list();
+        std::string heldText = encode(held);
+        for (int k = 0; k < 40; ++k) {
+            int id = static_cast<int>(rng() % 3000) + 1;
+            unsigned what = rng() % 4;
+            if (what == 0) {
+                m.editTask(id, "renamed " + std::to_string(round) + "\nline two", "");
+            } else if (what == 1) {
+                m.editTask(id, "", "notes " + std::to_string(k));
+            } else if (what == 2) {
+                m.toggleComplete(id);
+            } else {
+                m.removeById(id);
+                m.putTask(id, "back " + std::to_string(k), "", k % 2);
+            }
+        }
+        std::string heldPath = (dir / "held.csv").string();
+        if (!TaskManager::saveSnapshot(held, heldPath) || read(heldPath) != heldText) {
+            return "round " + std::to_string(round) + ": a held snapshot lost its lines";
+        }
+    }
+    std::vector<std::string> texts;
+    std::vector<std::string_view> parts;
+    std::string joined;
+    for (int i = 0; i < 3000; ++i) texts.push_back(i % 5 ? std::string(i % 37, static_cast<char>('a' + i % 26)) : "");
+    for (const auto& t : texts) {
+        parts.push_back(t);
+        joined += t;
+    }
+    if (!TaskManager::writeParts(path, parts) || read(path) != joined) return "gathered parts written wrongly";
+    return "";
+}
+
+// A save split over worker threads, each encoding its chunks and writing
+// them at its own offset, must produce the serial save's bytes and
+// fingerprint, whatever the split and whatever the file held before
+static std::string checkParallelSave(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string(), serial = (dir / "serial.csv").string();
+    auto read = [](const std::string& p) {
+        std::ifstream in(p, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    // A longer file already in place must not leave its tail behind
+    std::ofstream(path, std::ios::binary) << std::string(4 << 20, 'x');
+    TaskManager m(path);
+    for (int i = 0; i < 10000; ++i) m.addTask("task " + std::to_string(i), std::string(i % 50, 'n'));
+    m.setSaveThreads(4);
+    if (!m.save()) return "parallel save failed";
+    uint64_t serialHash = 0;
+    if (!TaskManager::saveSnapshot(m.list(), serial, &serialHash)) return "serial save failed";
+    std::string expected = read(serial);
+    if (read(path) != expected) return "parallel save differs from a serial one";
+    for (unsigned threads : {2u, 3u, 7u}) {
+        uint64_t hash = 0;
+        if (!TaskManager::saveSnapshot(m.list(), path, &hash, threads) || read(path) != expected) {
+            return std::to_string(threads) + " threads wrote a different file";
+        }
+        if (hash != serialHash) return std::to_string(threads) + " threads gave a different fingerprint";
+    }
+    // The index saved with the parallel save is keyed by its fingerprint,
+    // so a reload only takes it up if that matches the file
+    if (!m.save()) return "parallel save failed";
+    TaskManager reloaded(path);
+    if (!reloaded.load() || reloaded.list().size() != 10000) return "reload failed";
+    if (!reloaded.titleIndexStatus().ready) return "fingerprint of the parallel save does not match the file";
+    return "";
+}
+
+// The block scanner must find the same structural commas and newlines as
+// a byte-at-a-time walk tracking quotes, for quotes left open across any
+// number of 64-byte blocks and buffers of every tail length; tasks full
+// of quotes, commas and line breaks must then load back as saved
+static std::string checkCsvScanner(const std::filesystem::path& dir) {
+    std::mt19937 rng(5);
+    const char alphabet[] = {'"', '"', ',', '\n', 'a', 'b', ' ', 'x'};
+    for (int round = 0; round < 400; ++round) {
+        std::string buf(static_cast<size_t>(rng() % 300), ' ');
+        for (char& c : buf) c = alphabet[rng() % sizeof alphabet];
+        // Some rounds open a quote that runs over several blocks
+        if (round % 4 == 0 && buf.size() > 10) buf.replace(5, 0, "\"" + std::string(150, 'q') + "\"\"");
+        std::vector<std::pair<size_t, char>> want, got;
+        bool quoted = false;
+        for (size_t i = 0; i < buf.size(); ++i) {
+            if (buf[i] == '"') quoted = !quoted;
+            else if (!quoted && (buf[i] == ',' || buf[i] == '\n')) want.emplace_back(i, buf[i]);
+        }
+        CsvScanner::scan(buf, [&](size_t pos, char c) { got.emplace_back(pos, c); });
+        if (got != want) return "round " + std::to_string(round) + ": structural characters differ";
+    }
+
+    std::string path = (dir / "tasks.csv").string();
+    std::vector<std::pair<std::string, std::string>> texts;
+    {
+        TaskManager m(path);
+        for (int i = 0; i < 500; ++i) {
+            std::string title = "t" + std::to_string(i) + std::string(i % 70, i % 3 ? '"' : ',') + "end";
+            std::string notes = i % 2 ? "line one\nline \"two\", " + std::string(i % 90, '\n') : "";
+            texts.emplace_back(title, notes);
+            m.addTask(title, notes);
+        }
+        if (!m.save()) return "save failed";
+    }
+    TaskManager m(path);
+    if (!m.load() || m.list().size() != texts.size()) return "reload lost tasks";
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const Task* t = m.find(static_cast<int>(i) + 1);
+        if (!t || t->getTitle() != texts[i].first || t->getNotes() != texts[i].second) {
+            return "task " + std::to_string(i + 1) + " did not survive a save and load";
+        }
+    }
+    return "";
+}
+
+// Snapshots: chunks are named by SHA-256, a small edit must store only a
+// few new chunks, a restore must bring back the files of that moment and
+// drop newer journal and blob files, and a damaged chunk must fail the
+// restore before anything is overwritten
+static std::string checkSnapshots(const std::filesystem::path& dir) {
+    const std::pair<std::string, const char*> vectors[] = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {std::string(1000000, 'a'), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"},
+    };
+    for (const auto& [text, digest] : vectors) {
+        if (Sha256::of(text) != digest) return "SHA-256 of " + std::to_string(text.size()) + " bytes is wrong";
+    }
+
+    std::string path = (dir / "tasks.csv").string();
+    auto read = [](const std::string& p) {
+        std::ifstream in(p, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    {
+        TaskManager m(path);
+        for (int i = 0; i < 20000; ++i) m.addTask("task number " + std::to_string(i), i % 7 ? "" : "some notes");
+        m.addTask("big", std::string(BlobStore::kThreshold, 'b'));
+        if (!m.save()) return "save failed";
+    }
+    std::string before = read(path);
+    SnapshotStore store(path);
+    SnapshotStore::Stats first, second;
+    if (!store.take("one", first) || first.files != 2) return "first snapshot failed";
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        m.load();
+        m.editTask(10000, "renamed in the middle", "");
+        if (!m.save()) return "save failed";
+        m.addTask("only in the journal", "");
+    }
+    if (!store.take("two", second)) return "second snapshot failed";
+    if (second.newChunks > 4 || second.newBytes * 10 > second.bytes) {
+        return "an edit stored " + std::to_string(second.newChunks) + " of " + std::to_string(second.chunks) +
+               " chunks again";
+    }
+    if (!store.restore("one")) return "restore failed";
+    if (read(path) != before) return "restored file differs";
+    if (std::filesystem::exists(path + ".journal")) return "journal from after the snapshot kept";
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        if (!m.load() || m.list().size() != 20001 || m.find(10000)->getTitle() != "task number 9999") {
+            return "restored list is wrong";
+        }
+        if (m.find(20001)->getNotes() != std::string(BlobStore::kThreshold, 'b')) return "restored blob is wrong";
+    }
+    // Damage one chunk of "two": the restore must fail and change nothing
+    std::string manifest = read((dir / "tasks.csv.snapshots" / "manifests" / "two").string());
+    size_t at = manifest.rfind("chunk,");
+    std::string hash = manifest.substr(at + 6, 64);
+    std::ofstream(dir / "tasks.csv.snapshots" / "chunks" / hash.substr(0, 2) / hash.substr(2)) << "garbage";
+    if (store.restore("two")) return "restored from a damaged chunk";
+    if (read(path) != before) return "a failed restore changed the file";
+    if (store.take("../escape", second) || store.list() != std::vector<std::string>{"one", "two"}) {
+        return "bad snapshot name accepted";
+    }
+    return "";
+}
+
+// Counts the allocations it passes on to another resource, and the
+// bytes they hold
+class CountingResource : public std::pmr::memory_resource {
+    std::pmr::memory_resource* upstream;
+
+public:
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+    explicit CountingResource(std::pmr::memory_resource* up = std::pmr::new_delete_resource()) : upstream(up) {}
+
+private:
+    void* do_allocate(size_t bytes, size_t align) override {
+        ++allocations;
+        this->bytes += bytes;
+        return upstream->allocate(bytes, align);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t align) override {
+        this->bytes -= bytes;
+        upstream->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// Adding, loading and parsing a task allocate once per string too long to
+// keep inline and nothing more. Each figure is the count with such strings
+// less the count with short ones, which leaves out chunk storage.
+static std::string checkAllocations(const std::filesystem::path& dir) {
+    constexpr size_t kTasks = 10 * kTaskChunkSize;
+    const std::string longTitle(48, 't'), longNotes(40, 'n');
+    auto expect = [&](const char* what, size_t withLong, size_t withShort) -> std::string {
+        size_t n = withLong - withShort;
+        if (n == 2 * kTasks) return "";
+        return std::string(what) + ": " + std::to_string(n) + " allocations for " + std::to_string(2 * kTasks) +
+               " long strings";
+    };
+    // A journaled add logs an op whose strings then move into the task
+    auto addCost = [&](std::string_view title, std::string_view notes, bool adopt, bool journaled) {
+        std::filesystem::remove(dir / "add.csv.journal");
+        CountingResource counter;
+        TaskManager m((dir / "add.csv").string(), &counter);
+        if (journaled) m.enableJournal();
+        for (size_t i = 0; i < kTasks; ++i) {
+            if (adopt) m.addTask(Task(0, title, notes, false, Task::allocator_type(&counter)));
+            else m.addTask(title, notes);
+        }
+        return counter.allocations;
+    };
+    std::string error;
+    for (bool journaled : {false, true}) {
+        std::string add = journaled ? "journaled add" : "add", adopt = journaled ? "journaled adopt" : "adopt";
+        if (error.empty()) {
+            error = expect(add.c_str(), addCost(longTitle, longNotes, false, journaled),
+                           addCost("t", "", false, journaled));
+        }
+        if (error.empty()) {
+            error = expect(adopt.c_str(), addCost(longTitle, longNotes, true, journaled),
+                           addCost("t", "", true, journaled));
+        }
+    }
+    if (!error.empty()) return error;
+
+    auto loadCost = [&](std::string_view title, std::string_view notes) -> size_t {
+        std::string path = (dir / "load.csv").string();
+        {
+            TaskManager m(path);
+            for (size_t i = 0; i < kTasks; ++i) m.addTask(title, notes);
+            if (!m.save()) return 0;
+        }
+        // Without its saved title index, so that only the tasks are counted
+        std::filesystem::remove(path + ".idx");
+        CountingResource counter;
+        TaskManager m(path, &counter);
+        m.load();
+        return counter.allocations;
+    };
+    error = expect("load", loadCost(longTitle, longNotes), loadCost("t", ""));
+    if (!error.empty()) return error;
+
+    // Escaped quotes go through a scratch buffer, not the task's resource
+    const std::string_view titles[] = {longTitle, "please say \"\"hi\"\" to everyone on the team today"};
+    for (std::string_view title : titles) {
+        CountingResource counter;
+        Task t{Task::allocator_type(&counter)};
+        std::string line = "7,0,\"" + std::string(title) + "\",\"" + longNotes + "\"";
+        if (!Task::fromCsv(line, t) || counter.allocations != 2) {
+            return "parse: " + std::to_string(counter.allocations) + " allocations for 2 long strings";
+        }
+    }
+    return "";
+}
+
+// A version read before a reload must not match the reloaded task, even
+// though the task was loaded back fresh, exactly as it was
+static std::string checkCasReload(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    TaskManager m(path);
+    int id = m.addTask("task", "");
+    uint64_t seen = m.find(id)->getVersion();
+    if (!m.save() || !m.load()) return "save or load failed";
+    if (m.editTaskIf(id, seen, "stale", "")) return "edit with a version from before the reload succeeded";
+    uint64_t now = m.find(id)->getVersion();
+    if (now == seen) return "reload kept the version";
+
+    // Each applied step moves the version on by one, so a transaction can
+    // chain conditional steps on the same task
+    auto tx = m.begin();
+    tx.editTaskIf(id, now, "renamed", "");
+    tx.toggleCompleteIf(id, now + 1);
+    if (!tx.commit()) return "chained conditional steps failed";
+    if (m.find(id)->getVersion() != now + 2 || !m.find(id)->isCompleted()) return "chained steps not applied";
+    if (m.toggleCompleteIf(id, now)) return "toggle with an old version succeeded";
+    return "";
+}
+
+// With room for one list at a time, a script alternating between lists
+// evicts each in turn; every edit must reach its file all the same
+static std::string checkWorkspace(const std::filesystem::path& dir) {
+    std::ostringstream errors;
+    std::istringstream script("a add one\nb add two\n\na add three\na toggle 1\nb remove 1\n../c add out\n");
+    {
+        Workspace ws(dir.string(), 1);
+        if (applyScript(ws, script, errors) != 1) return "expected exactly the line naming ../c to fail";
+        if (ws.loadCount() != 4 || ws.evictionCount() != 3) {
+            return std::to_string(ws.loadCount()) + " loads and " + std::to_string(ws.evictionCount()) +
+                   " evictions, expected 4 and 3";
+        }
+    }
+    std::string a = (dir / "a.csv").string();
+    if (titlesOf(a) != "one,three") return "a holds " + titlesOf(a);
+    if (titlesOf((dir / "b.csv").string()) != "") return "b still holds " + titlesOf((dir / "b.csv").string());
+    TaskManager m(a);
+    if (!m.load() || !m.find(1) || !m.find(1)->isCompleted()) return "toggle in a was lost";
+    if (std::filesystem::exists(dir.parent_path() / "c.csv")) return "wrote outside the workspace";
+    return "";
+}
+
+// Changes journaled by the menu but never saved must come back on the
+// next start, even before the first save, and reach command-line tools
+static std::string checkJournal(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        m.addTask("one", "");
+        m.addTask("two", "");
+    }
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        if (!m.load()) return "load with only a journal failed";
+        if (!m.find(1) || !m.find(2)) return "unsaved tasks lost before the first save";
+        if (!m.save()) return "save failed";
+        m.toggleComplete(1);
+        m.removeById(2);
+        m.addTask("three", "");
+    }
+    std::string b = (dir / "b.csv").string(), delta = (dir / "delta").string();
+    if (!syncExport(path, "b", delta) || syncImport(b, delta) < 0) return "sync failed";
+    if (titlesOf(b) != "one,three") return "exported " + titlesOf(b) + ", expected one,three";
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        m.setCheckpointInterval(5);
+        if (!m.load() || !m.find(1) || !m.find(1)->isCompleted() || m.find(2)) return "unsaved edits lost";
+        m.addTask("four", "");
+        m.addTask("five", "");
+    }
+    // Replayed records count towards the interval: the fifth record, the
+    // second add, checkpointed, so the file alone holds everything
+    if (titlesOf(path) != "five,four,one,three") return "after checkpoint the file holds " + titlesOf(path);
+    return "";
+}
+
+// Replaying a long journal over a snapshot must rebuild exactly the live
+// list, and folding it in several partitions on threads must give every
+// id the same net change as folding it in one
+static std::string checkParallelReplay(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    auto state = [](TaskManager& m) {
+        std::string s;
+        for (const auto& t : m.list()) {
+            s += std::to_string(t.getId()) + ":" + std::string(t.getTitle()) + "|" + std::string(t.getNotes()) +
+                 (t.isCompleted() ? "|x\n" : "|\n");
+        }
+        return s;
+    };
+    std::string live;
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        m.setCheckpointInterval(0);
+        std::vector<int> ids;
+        for (int i = 0; i < 100; ++i) ids.push_back(m.addTask("base " + std::to_string(i), ""));
+        if (!m.save()) return "save failed";
+        std::mt19937 rng(3);
+        // Batched so the journal holds a few dozen records of 500 ops
+        for (int batch = 0; batch < 60; ++batch) {
+            auto tx = m.begin();
+            std::vector<int> gone;
+            for (int k = 0; k < 500; ++k) {
+                unsigned r = rng() % 100;
+                std::string text = std::to_string(batch) + "." + std::to_string(k);
+                if (ids.empty() || r < 30) {
+                    ids.push_back(tx.addTask("task " + text, r % 3 ? "" : "notes " + text, r % 2));
+                    continue;
+                }
+                size_t at = rng() % ids.size();
+                int id = ids[at];
+                if (r < 50) tx.editTask(id, "edited " + text, "");
+                else if (r < 65) tx.editTask(id, "", "notes " + text);
+                else if (r < 85) tx.toggleComplete(id);
+                else {
+                    tx.removeById(id);
+                    ids.erase(ids.begin() + static_cast<std::ptrdiff_t>(at));
+                }
+            }
+            if (!tx.commit()) return "batch " + std::to_string(batch) + " failed to commit";
+        }
+        live = state(m);
+    }
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        if (!m.load()) return "load failed";
+        if (state(m) != live) return "replay does not rebuild the live list";
+    }
+    JournalReplayer::Result one = JournalReplayer::run(path + ".journal", 1);
+    JournalReplayer::Result four = JournalReplayer::run(path + ".journal", 4);
+    if (four.partitions.size() != 4) return std::to_string(four.partitions.size()) + " partitions, expected 4";
+    if (one.ops != 30000 || four.ops != one.ops) return "replayed " + std::to_string(four.ops) + " ops";
+    size_t ids = 0;
+    for (auto& part : one.partitions) {
+        for (auto& [id, a] : part) {
+            const NetChange* b = four.find(id);
+            auto same = [](const auto& x, const auto& y) {
+                return x.has_value() == y.has_value() && (!x || std::string_view(*x) == std::string_view(*y));
+            };
+            if (!b || a.kind != b->kind || !same(a.title, b->title) || !same(a.notes, b->notes)
+                || a.completed != b->completed) {
+                return "task " + std::to_string(id) + " folds differently in partitions";
+            }
+            ++ids;
+        }
+    }
+    size_t total = 0;
+    for (auto& part : four.partitions) total += part.size();
+    if (total != ids) return "partitions hold " + std::to_string(total) + " ids, expected " + std::to_string(ids);
+    return "";
+}
+
+// Reads back the Arrow IPC files and streams that ArrowWriter produces,
+// for the round-trip check. It is written from the format's spec and
+// shares nothing with ArrowWriter or FlatBuilder, so a layout mistake
+// there cannot cancel out here. Bounds and alignment are checked
+// throughout, and the first problem found is kept in error.
+class ArrowTaskReader {
+public:
+    struct Row {
+        int id;
+        bool completed;
+        std::string title;
+        std::string notes;
+        bool operator==(const Row& o) const {
+            return id == o.id && completed == o.completed && title == o.title && notes == o.notes;
+        }
+    };
+
+    std::vector<Row> rows;
+    std::string error;
+
+    bool read(std::string_view file) {
+        data = file;
+        if (data.substr(0, 6) != "ARROW1") return readMessages(0, nullptr);
+        if (data.size() < 18 || data.substr(6, 2) != std::string_view("\0\0", 2)
+            || data.substr(data.size() - 6) != "ARROW1") {
+            return fail("bad file magic");
+        }
+        uint32_t length = load<uint32_t>(data, data.size() - 10);
+        if (length > data.size() - 18) return fail("bad footer length");
+        std::string_view footer = data.substr(data.size() - 10 - length, length);
+        Table f, schema;
+        if (!root(footer, f) || scalar<int16_t>(f, 0) != 4) return fail("footer is not metadata V5");
+        if (!child(f, 1, schema) || !checkSchema(schema)) return fail("bad schema in footer");
+        uint32_t dictionaries = 0, count = 0;
+        if (ref(f, 2) && vector(f, 2, 24, 8, dictionaries) && dictionaries) return fail("unexpected dictionaries");
+        size_t at = vector(f, 3, 24, 8, count);
+        if (!at) return fail("footer lists no record batches");
+        std::vector<Block> blocks;
+        for (uint32_t i = 0; i < count; ++i) {
+            blocks.push_back({load<uint64_t>(footer, at + 24 * i), load<uint32_t>(footer, at + 24 * i + 8),
+                              load<uint64_t>(footer, at + 24 * i + 16)});
+        }
+        std::vector<Block> seen;
+        if (!readMessages(8, &seen)) return false;
+        return seen == blocks || fail("footer blocks do not match the record batches");
+    }
+
+private:
+    struct Table {
+        std::string_view buf;
+        size_t pos = 0;
+        size_t vtable = 0;
+        uint16_t vsize = 0;
+        uint16_t tsize = 0;
+    };
+
+    struct Block {
+        uint64_t offset;
+        uint32_t metadataLength;
+        uint64_t bodyLength;
+        bool operator==(const Block& o) const {
+            return offset == o.offset && metadataLength == o.metadataLength && bodyLength == o.bodyLength;
+        }
+    };
+
+    std::string_view data;
+
+    bool fail(const std::string& what) {
+        if (error.empty()) error = what;
+        return false;
+    }
+
+    template <typename T>
+    T load(std::string_view buf, size_t at) {
+        T v{};
+        if (at > buf.size() || buf.size() - at < sizeof(T)) fail("read past the end of a buffer");
+        else std::memcpy(&v, buf.data() + at, sizeof(T));
+        return v;
+    }
+
+    bool table(std::string_view buf, size_t pos, Table& t) {
+        if (pos % 4 || pos + 4 > buf.size()) return fail("misplaced table");
+        int64_t vtable = static_cast<int64_t>(pos) - load<int32_t>(buf, pos);
+        if (vtable < 0 || vtable % 2 || static_cast<size_t>(vtable) + 4 > buf.size()) return fail("bad vtable");
+        t = {buf, pos, static_cast<size_t>(vtable), load<uint16_t>(buf, vtable), load<uint16_t>(buf, vtable + 2)};
+        if (t.vsize < 4 || t.vsize % 2 || t.pos + t.tsize > buf.size()) return fail("bad vtable");
+        return true;
+    }
+
+    bool root(std::string_view buf, Table& t) { return table(buf, load<uint32_t>(buf, 0), t); }
+
+    // Where field i of t is stored, or 0 if it is absent
+    size_t field(const Table& t, size_t i) {
+        if (4 + 2 * i >= t.vsize) return 0;
+        uint16_t offset = load<uint16_t>(t.buf, t.vtable + 4 + 2 * i);
+        if (offset && offset >= t.tsize) fail("field outside its table");
+        return offset ? t.pos + offset : 0;
+    }
+
+    template <typename T>
+    T scalar(const Table& t, size_t i) {
+        size_t at = field(t, i);
+        if (at % sizeof(T)) fail("misaligned field");
+        return at ? load<T>(t.buf, at) : T{};
+    }
+
+    size_t ref(const Table& t, size_t i) {
+        size_t at = field(t, i);
+        if (!at) return 0;
+        if (at % 4) return fail("misaligned offset"), 0;
+        return at + load<uint32_t>(t.buf, at);
+    }
+
+    bool child(const Table& t, size_t i, Table& out) {
+        size_t at = ref(t, i);
+        return at ? table(t.buf, at, out) : fail("missing table");
+    }
+
+    // Start of the elements of vector field i, each size bytes aligned to
+    // align, or 0 if it is missing or malformed
+    size_t vector(const Table& t, size_t i, size_t size, size_t align, uint32_t& count) {
+        size_t at = ref(t, i);
+        if (!at) return fail("missing vector"), 0;
+        if (at % 4 || (at + 4) % align) return fail("misaligned vector"), 0;
+        count = load<uint32_t>(t.buf, at);
+        if (at + 4 + uint64_t(count) * size > t.buf.size()) return fail("vector past the end"), 0;
+        return at + 4;
+    }
+
+    std::string_view string(const Table& t, size_t i) {
+        size_t at = ref(t, i);
+        uint32_t n = at ? load<uint32_t>(t.buf, at) : 0;
+        if (!at || at + 4 + n >= t.buf.size() || t.buf[at + 4 + n] != '\0') return fail("bad string"), "";
+        return t.buf.substr(at + 4, n);
+    }
+
+    bool checkSchema(const Table& schema) {
+        static const std::pair<const char*, uint8_t> expected[] = {
+            {"id", 2}, {"completed", 6}, {"title", 5}, {"notes", 5}};  // Int, Bool, Utf8
+        uint32_t count = 0;
+        size_t at = vector(schema, 1, 4, 4, count);
+        if (scalar<int16_t>(schema, 0) != 0 || !at || count != std::size(expected)) return false;
+        for (uint32_t i = 0; i < count; ++i) {
+            Table f, type;
+            uint32_t children = 0;
+            if (!table(schema.buf, at + 4 * i + load<uint32_t>(schema.buf, at + 4 * i), f)) return false;
+            if (string(f, 0) != expected[i].first || scalar<uint8_t>(f, 2) != expected[i].second) return false;
+            if (!child(f, 3, type) || !vector(f, 5, 4, 4, children) || children) return false;
+            if (expected[i].second == 2 && (scalar<int32_t>(type, 0) != 32 || !scalar<uint8_t>(type, 1))) return false;
+        }
+        return true;
+    }
+
+    // Encapsulated messages from pos up to the end-of-stream marker: one
+    // schema, then record batches, whose blocks go to batches if given
+    bool readMessages(size_t pos, std::vector<Block>* batches) {
+        for (bool first = true;; first = false) {
+            if (pos % 8) return fail("misaligned message");
+            if (load<uint32_t>(data, pos) != 0xFFFFFFFFu) return fail("missing continuation marker");
+            uint32_t length = load<uint32_t>(data, pos + 4);
+            if (!error.empty()) return false;
+            if (length == 0) return !first || fail("no schema message");
+            if (length % 8 || length > data.size() - pos - 8) return fail("bad metadata length");
+            Table message, header;
+            std::string_view meta = data.substr(pos + 8, length);
+            if (!root(meta, message) || scalar<int16_t>(message, 0) != 4) return fail("message is not metadata V5");
+            uint8_t type = scalar<uint8_t>(message, 1);
+            uint64_t bodyLength = scalar<int64_t>(message, 3);
+            if (!child(message, 2, header) || bodyLength > data.size() - pos - 8 - length) return fail("bad message");
+            std::string_view body = data.substr(pos + 8 + length, bodyLength);
+            if (first != (type == 1)) return fail("schema message out of place");
+            if (first && !checkSchema(header)) return fail("bad schema");
+            if (!first && (type != 3 || !readBatch(header, body))) return fail("bad record batch");
+            if (!first && batches) batches->push_back({pos, 8 + length, bodyLength});
+            pos += 8 + length + bodyLength;
+        }
+    }
+
+    bool readBatch(const Table& batch, std::string_view body) {
+        int64_t n = scalar<int64_t>(batch, 0);
+        uint32_t nodeCount = 0, bufferCount = 0;
+        size_t nodes = vector(batch, 1, 16, 8, nodeCount);
+        size_t list = vector(batch, 2, 16, 8, bufferCount);
+        if (n <= 0 || !nodes || !list || nodeCount != 4 || bufferCount != 10) return false;
+        for (uint32_t i = 0; i < nodeCount; ++i) {
+            // Every column is n long with no nulls
+            size_t at = nodes + 16 * i;
+            if (load<int64_t>(batch.buf, at) != n || load<int64_t>(batch.buf, at + 8)) return false;
+        }
+        std::string_view buffers[10];
+        for (uint32_t i = 0; i < bufferCount; ++i) {
+            uint64_t offset = load<uint64_t>(batch.buf, list + 16 * i);
+            uint64_t length = load<uint64_t>(batch.buf, list + 16 * i + 8);
+            if (offset % 8 || offset > body.size() || length > body.size() - offset) return fail("misplaced buffer");
+            buffers[i] = body.substr(offset, length);
+        }
+        size_t count = static_cast<size_t>(n);
+        if (buffers[1].size() < 4 * count || buffers[3].size() < (count + 7) / 8) return fail("short column");
+        auto strings = [&](std::string_view offsets, std::string_view chars, size_t i, std::string& out) {
+            int32_t from = load<int32_t>(offsets, 4 * i), to = load<int32_t>(offsets, 4 * i + 4);
+            if (from < 0 || to < from || static_cast<size_t>(to) > chars.size()) return false;
+            if ((i == 0 && from != 0) || (i + 1 == count && static_cast<size_t>(to) != chars.size())) return false;
+            out.assign(chars.substr(from, to - from));
+            return true;
+        };
+        for (size_t i = 0; i < count; ++i) {
+            Row r{load<int32_t>(buffers[1], 4 * i), ((buffers[3][i / 8] >> (i % 8)) & 1) != 0, {}, {}};
+            if (!strings(buffers[5], buffers[6], i, r.title) || !strings(buffers[8], buffers[9], i, r.notes)) {
+                return fail("bad string offsets");
+            }
+            rows.push_back(std::move(r));
+        }
+        return error.empty();
+    }
+};
+
+// Both Arrow outputs must read back, by a decoder of their own, as the
+// tasks that were written: across a batch boundary, with completion bits
+// past the first byte, and with escaped, multi-byte and blob notes
+static std::string checkArrowRoundTrip(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    {
+        TaskManager m(path);
+        for (int i = 1; i <= 70000; ++i) m.addTask("task " + std::to_string(i), i % 3 ? "" : "note");
+        for (int id = 1; id <= 70000; id += 7) m.toggleComplete(id);
+        for (int id = 2; id <= 70000; id += 1000) m.removeById(id);
+        m.addTask("na\xc3\xafve \xe2\x98\x95", "a, \"quoted\"\nsecond line");
+        m.addTask("long notes", std::string(3000, 'x'));
+        if (!m.save()) return "save failed";
+    }
+    TaskManager m(path);
+    if (!m.load()) return "load failed";
+    std::vector<ArrowTaskReader::Row> expected;
+    for (const Task& t : m.list()) {
+        expected.push_back({t.getId(), t.isCompleted(), std::string(t.getTitle()), std::string(t.getNotes())});
+    }
+    for (bool stream : {false, true}) {
+        std::string out = (dir / (stream ? "tasks.arrows" : "tasks.arrow")).string(), bytes;
+        std::string what = stream ? "stream: " : "file: ";
+        ArrowWriter::Stats stats;
+        if (!ArrowWriter::write(m.list(), out, stream, &stats)) return what + "write failed";
+        if (stats.batches < 2) return what + "expected more than one record batch";
+        std::ifstream in(out, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        ArrowTaskReader reader;
+        if (!reader.read(bytes)) return what + reader.error;
+        if (reader.rows.size() != expected.size()) {
+            return what + std::to_string(reader.rows.size()) + " rows, expected " + std::to_string(expected.size());
+        }
+        for (size_t i = 0; i < expected.size(); ++i) {
+            if (!(reader.rows[i] == expected[i])) return what + "row " + std::to_string(i) + " differs";
+        }
+    }
+    return "";
+}
+
+// Queries answered through the title index must find exactly what a
+// plain scan of the same tasks finds, in id order, also after edits
+static std::string checkQuery(const std::filesystem::path& dir) {
+    TaskManager m((dir / "tasks.csv").string());
+    const char* words[] = {"alpha", "beta", "Gamma", "delta"};
+    for (int i = 0; i < 3000; ++i) {
+        std::string title = std::string(words[i % 4]) + " " + words[(i / 4) % 4] + " item";
+        m.addTask(title, i % 5 ? "" : "urgent");
+    }
+    for (int id = 1; id <= 3000; id += 3) m.toggleComplete(id);
+    // Ids out of store order: re-add an early task at the end
+    m.removeById(10);
+    m.putTask(10, "alpha alpha item", "", false);
+    const char* queries[] = {"alpha", "gamma beta", "alpha status:done", "delta notes:urgent", "missing", ""};
+    for (int round = 0; round < 2; ++round) {
+        m.buildIndexesInBackground();
+        while (!m.titleIndexStatus().ready) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        for (const char* text : queries) {
+            TaskQuery q = TaskQuery::parse(text);
+            std::vector<int> expected;
+            for (const auto& t : m.list()) {
+                if (q.matches(t)) expected.push_back(t.getId());
+            }
+            std::sort(expected.begin(), expected.end());
+            if (m.query(text) != expected) return "query \"" + std::string(text) + "\" differs from a scan";
+        }
+        m.editTask(20, "beta gamma renamed", "");
+    }
+    return "";
+}
+
+// The index saved beside a snapshot must be taken up on the next load
+// without a rebuild and answer as a scan does; one left from another
+// snapshot, cut short or with a list pointing outside the file must be
+// passed over, not trusted
+static std::string checkIndexFile(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    const char* words[] = {"alpha", "beta", "gamma", "delta", "epsilon"};
+    const char* queries[] = {"alpha", "beta gamma", "epsilon alpha delta", "task", "missing", "alpha missing"};
+    {
+        TaskManager m(path);
+        for (int i = 0; i < 5000; ++i) {
+            m.addTask(std::string(words[i % 5]) + " " + words[(i / 5) % 5] + " task", "");
+        }
+        if (!m.save()) return "save failed";
+    }
+    std::string saved = path + ".saved-idx";
+    std::filesystem::copy_file(path + ".idx", saved);
+    // expectMapped: whether the index must come from the file
+    auto probe = [&](bool expectMapped) -> std::string {
+        TaskManager m(path);
+        if (!m.load()) return "load failed";
+        if (m.titleIndexStatus().ready != expectMapped) {
+            return expectMapped ? "saved index not used" : "bad index file used";
+        }
+        for (const char* q : queries) {
+            if (m.searchTitles(q) != scanTitles(m.list(), q)) {
+                return "search \"" + std::string(q) + "\" differs from a scan";
+            }
+        }
+        return "";
+    };
+    std::string error = probe(true);
+    if (!error.empty()) return error;
+    {
+        TaskManager m(path);
+        m.load();
+        m.addTask("alpha zeta task", "");
+        if (!m.save()) return "save failed";
+    }
+    std::filesystem::copy_file(saved, path + ".idx", std::filesystem::copy_options::overwrite_existing);
+    if (!(error = probe(false)).empty()) return "stale file: " + error;
+    {
+        TaskManager m(path);
+        m.load();
+        if (!m.save()) return "save failed";
+    }
+    std::filesystem::copy_file(path + ".idx", saved, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::resize_file(path + ".idx", std::filesystem::file_size(saved) - 8);
+    if (!(error = probe(false)).empty()) return "short file: " + error;
+    // The first term's list offset, just past the header and its word fields
+    std::filesystem::copy_file(saved, path + ".idx", std::filesystem::copy_options::overwrite_existing);
+    {
+        std::fstream f(path + ".idx", std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(sizeof(TitleIndex::Header) + 8);
+        f.write("\xff\xff\xff\xff\xff\xff\xff\x0f", 8);
+    }
+    if (!(error = probe(false)).empty()) return "bad offset: " + error;
+    return "";
+}
+
+// Until a background build for the current state is done, searches and
+// title order must come from a scan; a build overtaken by an edit must
+// never be served, and once a fresh one lands it must agree with a scan
+static std::string checkBackgroundIndex(const std::filesystem::path& dir) {
+    TaskManager m((dir / "tasks.csv").string());
+    const char* words[] = {"Alpha", "beta", "gamma", "delta", "epsilon", "zeta"};
+    for (int i = 0; i < 20000; ++i) {
+        m.addTask(std::string(words[i % 6]) + " " + words[(i / 6) % 6] + " " + std::to_string(i % 97), "");
+    }
+    auto byTitle = [&] {
+        std::vector<std::pair<std::string, int>> keys;
+        for (const auto& t : m.list()) {
+            std::string key(t.getTitle());
+            for (char& c : key) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            keys.emplace_back(key, t.getId());
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<int> ids;
+        for (const auto& k : keys) ids.push_back(k.second);
+        return ids;
+    };
+    auto agree = [&](const char* when) -> std::string {
+        for (const char* q : {"alpha", "beta zeta", "gamma 42", "omega"}) {
+            if (m.searchTitles(q) != scanTitles(m.list(), q)) return std::string(when) + ": search \"" + q + "\" wrong";
+        }
+        if (m.idsByTitle() != byTitle()) return std::string(when) + ": title order wrong";
+        return "";
+    };
+    auto settle = [&] {
+        while (m.titleIndexStatus().building || m.titleOrderStatus().building) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+    if (m.titleIndexStatus().ready || m.titleOrderStatus().ready) return "indexes ready before any build";
+    // The first search scans and starts the builds; an edit then makes them stale
+    std::string error = agree("while building");
+    if (!error.empty()) return error;
+    m.editTask(7, "omega renamed", "");
+    settle();
+    if (m.titleIndexStatus().ready || m.titleOrderStatus().ready) return "a stale index is served";
+    if (!(error = agree("after an edit")).empty()) return error;
+    settle();
+    if (!m.titleIndexStatus().ready || !m.titleOrderStatus().ready) return "indexes not rebuilt";
+    if (m.titleIndexStatus().progress != 1.0) return "finished build not at full progress";
+    if (m.searchTitles("omega") != std::vector<int>{7}) return "index misses the edit";
+    return agree("from the index");
+}
+
+// Lists of many shapes packed into one arena, so most start at odd bit
+// offsets, must give back their ids, and rank and seek must agree with a
+// binary search of the plain ids, across sample boundaries included
+static std::string checkEliasFano(const std::filesystem::path&) {
+    std::mt19937 rng(7);
+    std::vector<std::vector<uint32_t>> lists;
+    for (size_t n : {0, 1, 2, 3, 64, 1000, 20000}) {
+        for (uint32_t spread : {1u, 3u, 1000u}) {
+            std::set<uint32_t> ids;
+            while (ids.size() < n) ids.insert(static_cast<uint32_t>(rng() % (n * spread + 1)));
+            lists.emplace_back(ids.begin(), ids.end());
+        }
+    }
+    lists.push_back({0, UINT32_MAX});
+    std::pmr::vector<uint64_t> arena;
+    EliasFano::Writer out(arena, 0);
+    std::vector<EliasFano::List> coded;
+    for (const auto& ids : lists) coded.push_back(EliasFano::append(out, ids.data(), ids.size()));
+    for (size_t i = 0; i < lists.size(); ++i) {
+        const auto& ids = lists[i];
+        std::string name = "list " + std::to_string(i) + " of " + std::to_string(ids.size());
+        std::vector<uint32_t> back;
+        EliasFano::forEach(arena.data(), coded[i], [&](uint32_t id) { back.push_back(id); });
+        if (back != ids) return name + " decodes wrongly";
+        uint32_t top = ids.empty() ? 100 : std::min<uint64_t>(UINT32_MAX, uint64_t(ids.back()) + 2);
+        for (int q = 0; q < 200; ++q) {
+            uint32_t x = q < 2 ? (q ? top : 0) : static_cast<uint32_t>(rng() % (uint64_t(top) + 1));
+            auto it = std::lower_bound(ids.begin(), ids.end(), x);
+            if (EliasFano::rank(arena.data(), coded[i], x) != static_cast<uint32_t>(it - ids.begin())) {
+                return name + ": wrong rank of " + std::to_string(x);
+            }
+            // Seeks move forward from wherever the cursor stands
+            EliasFano::Cursor c(arena.data(), coded[i]);
+            size_t at = ids.empty() ? 0 : rng() % ids.size();
+            for (size_t k = 0; k < at; ++k) c.next();
+            c.seek(x);
+            auto want = std::lower_bound(ids.begin() + static_cast<std::ptrdiff_t>(at), ids.end(), x);
+            if (c.valid() != (want != ids.end()) || (c.valid() && c.value() != *want)) {
+                return name + ": seek to " + std::to_string(x) + " from " + std::to_string(at) + " went wrong";
+            }
+        }
+    }
+    return "";
+}
+
+// Adds, removes, updates and re-adds in shuffled order must leave the
+// paged file agreeing with a plain map of the same tasks, by id lookup,
+// by range scan and after reopening. Churn at a fixed number of tasks
+// must reuse the pages it empties rather than grow the file.
+static std::string checkPagedStore(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.db").string();
+    std::map<int, std::pair<std::string, bool>> model;
+    std::mt19937 rng(42);
+    auto store = PagedTaskStore::create(path, 16);
+    if (!store) return "create failed";
+    auto put = [&](int id, bool completed) {
+        // Every tenth note is too long to stay on a data page
+        std::string notes(id % 10 ? id % 50 : 2000, 'n');
+        std::string title = "task " + std::to_string(id) + (completed ? " done" : "");
+        model[id] = {title + "|" + notes, completed};
+        return Task(id, title, notes, completed);
+    };
+    std::vector<int> ids(4000);
+    std::iota(ids.begin(), ids.end(), 1);
+    std::shuffle(ids.begin(), ids.end(), rng);
+    for (int id : ids) {
+        if (!store->add(put(id, false))) return "add " + std::to_string(id) + " failed";
+    }
+    if (store->add(put(ids[0], false))) return "a repeated id was added";
+    uint32_t filled = store->pageCount();
+    int next = 4001;
+    for (int round = 0; round < 6; ++round) {
+        std::shuffle(ids.begin(), ids.end(), rng);
+        for (size_t i = 0; i < ids.size() / 2; ++i) {
+            if (!store->removeById(ids[i])) return "remove " + std::to_string(ids[i]) + " failed";
+            model.erase(ids[i]);
+            // Half of the removed ids come back, the rest are replaced
+            ids[i] = i % 2 ? ids[i] : next++;
+            if (!store->add(put(ids[i], false))) return "re-add " + std::to_string(ids[i]) + " failed";
+        }
+        for (size_t i = ids.size() / 2; i < ids.size(); i += 3) {
+            if (!store->update(put(ids[i], round % 2 == 0))) return "update " + std::to_string(ids[i]) + " failed";
+        }
+        if (store->removeById(next + 100)) return "removed a missing id";
+    }
+    if (store->size() != model.size()) return "size " + std::to_string(store->size()) + " after churn";
+    if (store->pageCount() > filled * 3 / 2) {
+        return std::to_string(store->pageCount()) + " pages after churn, " + std::to_string(filled) + " when filled";
+    }
+    for (int reopened = 0; reopened < 2; ++reopened) {
+        std::string how = reopened ? " after reopening" : "";
+        Task t;
+        for (const auto& [id, expected] : model) {
+            if (!store->get(id, t)) return "get " + std::to_string(id) + " failed" + how;
+            std::string got = std::string(t.getTitle()) + "|" + std::string(t.getNotes());
+            if (got != expected.first || t.isCompleted() != expected.second) {
+                return "task " + std::to_string(id) + " differs" + how;
+            }
+        }
+        auto it = model.lower_bound(1000);
+        bool inOrder = true;
+        bool scanned = store->scanRange(1000, 3000, [&](const Task& t) {
+            inOrder = inOrder && it != model.end() && it->first == t.getId();
+            if (it != model.end()) ++it;
+        });
+        if (!scanned || !inOrder || (it != model.end() && it->first <= 3000)) return "range scan differs" + how;
+        if (!store->flush()) return "flush failed";
+        store = PagedTaskStore::open(path, 16, true);
+        if (!store) return "reopen failed";
+    }
+    return "";
+}
+
+// Long notes go to blob files and read back the same after a reload, and
+// compaction keeps the blob files in proportion to the live notes. A blob
+// that cannot be read must fail the save rather than be compacted away.
+static std::string checkBlobs(const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    auto noteFor = [](int id, int round) { return std::string(1500 + id, static_cast<char>('a' + (id + round) % 26)); };
+    auto verify = [&](int round) -> std::string {
+        TaskManager m(path);
+        if (!m.load()) return "load failed";
+        for (int id = 1; id <= 40; ++id) {
+            const Task* t = m.find(id);
+            std::string expected = id % 4 ? noteFor(id, round) : "short";
+            if (!t || t->getNotes() != expected) return "notes of task " + std::to_string(id) + " differ";
+        }
+        return "";
+    };
+    {
+        TaskManager m(path);
+        for (int id = 1; id <= 40; ++id) m.addTask("task", id % 4 ? noteFor(id, 0) : "short");
+        if (!m.save()) return "save failed";
+        if (std::filesystem::file_size(path) > 4096) return "long notes stayed in the task file";
+    }
+    if (std::string error = verify(0); !error.empty()) return error;
+    for (int round = 1; round <= 4; ++round) {
+        TaskManager m(path);
+        m.load();
+        for (int id = 1; id <= 40; ++id) {
+            if (id % 4) m.editTask(id, "", noteFor(id, round));
+        }
+        if (!m.save()) return "save failed in round " + std::to_string(round);
+        if (std::string error = verify(round); !error.empty()) return error + " in round " + std::to_string(round);
+    }
+    uint64_t blobBytes = 0;
+    size_t blobFiles = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().filename().string().rfind("tasks.csv.blobs.", 0) == 0) {
+            ++blobFiles;
+            blobBytes += entry.file_size();
+        }
+    }
+    if (blobFiles != 1 || blobBytes > 3 * 30 * 1600 + (64u << 10)) {
+        return std::to_string(blobFiles) + " blob files of " + std::to_string(blobBytes) + " bytes after compaction";
+    }
+
+    // 100 KB of garbage ahead of a blob with a damaged header
+    std::string bad = (dir / "bad.csv").string();
+    {
+        std::ofstream blobs(bad + ".blobs.1", std::ios::binary);
+        blobs << std::string(100 << 10, '\0') << "bXXX" << std::string(4, '\0') << std::string(2000, 'n');
+        std::ofstream tasks(bad);
+        tasks << "1,0,\"task\",\"@blob:1:" << (100 << 10) + 8 << ":2000\"\n";
+    }
+    TaskManager m(bad);
+    if (!m.load()) return "load of the damaged list failed";
+    if (m.save()) return "compacting an unreadable blob succeeded";
+    if (!std::filesystem::exists(bad + ".blobs.1")) return "the unreadable blob's file was deleted";
+    TaskManager again(bad);
+    again.load();
+    if (!again.find(1) || again.find(1)->storedNotes().substr(0, 6) != "@blob:") return "the blob reference was lost";
+    return "";
+}
+
+// External sort: a loser tree merges any number of sources, some empty,
+// into one order, and a sort with a budget small enough to need several
+// merge passes writes what a stable in-memory sort would, by every key,
+// with --unique keeping the first record of an id
+static std::string checkExternalSort(const std::filesystem::path& dir) {
+    std::mt19937 rng(95);
+    for (size_t k : {1, 2, 3, 5, 8, 13}) {
+        std::vector<std::vector<int>> sources(k);
+        std::vector<int> expected;
+        for (auto& s : sources) {
+            s.resize(rng() % 50);
+            for (int& v : s) v = static_cast<int>(rng() % 100);
+            std::sort(s.begin(), s.end());
+            expected.insert(expected.end(), s.begin(), s.end());
+        }
+        std::sort(expected.begin(), expected.end());
+        std::vector<size_t> pos(k);
+        auto beats = [&](int a, int b) {
+            bool hasA = pos[a] < sources[a].size(), hasB = pos[b] < sources[b].size();
+            if (!hasA || !hasB) return hasA && !hasB;
+            return sources[a][pos[a]] < sources[b][pos[b]];
+        };
+        LoserTree<decltype(beats)> tree(k, beats);
+        std::vector<int> merged;
+        for (int w = tree.winner(); pos[w] < sources[w].size(); w = tree.winner()) {
+            merged.push_back(sources[w][pos[w]++]);
+            tree.advance();
+        }
+        if (merged != expected) return "loser tree over " + std::to_string(k) + " sources out of order";
+    }
+
+    const char* words[] = {"alpha", "Beta", "gamma, delta", "BETA", "say \"hi\"", "Alpha"};
+    std::vector<Task> input;
+    std::string csv;
+    for (int i = 0; i < 30000; ++i) {
+        input.emplace_back(static_cast<int>(rng() % 3000) + 1, words[rng() % 6], i % 5 ? "" : "n", rng() % 2 == 0);
+        csv += input.back().toCsv() + "\n";
+    }
+    std::string inPath = (dir / "unsorted.csv").string(), outPath = (dir / "sorted.csv").string();
+    std::ofstream(inPath, std::ios::binary) << csv;
+    for (SortKey key : {SortKey::Id, SortKey::Title, SortKey::Status}) {
+        for (bool unique : {false, true}) {
+            if (unique && key != SortKey::Id) continue;
+            ExternalSorter::Options opts;
+            opts.key = key;
+            opts.unique = unique;
+            opts.memoryBytes = 3 * (64 << 10);  // three runs open at once
+            ExternalSorter::Stats stats;
+            {
+                ExternalSorter sorter(opts);
+                if (!sorter.sort(inPath, outPath, stats)) return "sort failed";
+            }
+            if (stats.runs <= 9 || stats.passes < 3) return "budget did not force several merge passes";
+            std::vector<Task> sorted = input;
+            std::stable_sort(sorted.begin(), sorted.end(), [key](const Task& a, const Task& b) {
+                if (key == SortKey::Title) {
+                    std::string x(a.getTitle()), y(b.getTitle());
+                    for (char& c : x) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                    for (char& c : y) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                    if (x != y) return x < y;
+                } else if (key == SortKey::Status && a.isCompleted() != b.isCompleted()) {
+                    return b.isCompleted();
+                }
+                return a.getId() < b.getId();
+            });
+            std::string expected;
+            for (size_t i = 0; i < sorted.size(); ++i) {
+                if (unique && i && sorted[i].getId() == sorted[i - 1].getId()) continue;
+                expected += sorted[i].toCsv() + "\n";
+            }
+            std::ifstream in(outPath, std::ios::binary);
+            if (std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()) != expected) {
+                return "sorted file differs from a stable sort";
+            }
+        }
+    }
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() == ".tmp") return "run file left behind";
+    }
+    return "";
+}
+
+// Buffer pool: sequential fetches read ahead in one call, a fully pinned
+// pool refuses another page, CLOCK spares a page used since the hand last
+// passed, changed pages reach the file on eviction and on flush, and a
+// lookup in a packed store touches only its index path and record page
+static std::string checkBufferPool(const std::filesystem::path& dir) {
+    std::string path = (dir / "pages.db").string();
+    PageFile file;
+    if (!file.open(path, true, true)) return "open failed";
+    std::vector<char> buf(PageFile::kPageSize);
+    for (uint32_t p = 0; p < 40; ++p) {
+        std::fill(buf.begin(), buf.end(), static_cast<char>('a' + p % 26));
+        if (!file.write(file.allocate(), buf.data())) return "write failed";
+    }
+    {
+        BufferPool pool(file, 8, 2);
+        for (uint32_t p = 0; p < 40; ++p) {
+            BufferPool::PageRef ref = pool.fetch(p, true);
+            char want = static_cast<char>('a' + p % 26);
+            if (!ref || ref.data()[0] != want || ref.data()[PageFile::kPageSize - 1] != want) {
+                return "page " + std::to_string(p) + " read wrong";
+            }
+        }
+        const BufferPool::Stats& s = pool.statistics();
+        if (s.reads != 14 || s.misses != 14 || s.readAhead != 26 || s.hits != 26) {
+            return "a sequential scan took " + std::to_string(s.reads) + " reads";
+        }
+    }
+    {
+        BufferPool pool(file, 4, 0);
+        std::vector<BufferPool::PageRef> held;
+        for (uint32_t p = 0; p < 4; ++p) held.push_back(pool.fetch(p));
+        if (pool.fetch(4)) return "fetched with every frame pinned";
+        held.pop_back();
+        if (!pool.fetch(4)) return "no frame after an unpin";
+    }
+    {
+        BufferPool pool(file, 4, 0);
+        for (uint32_t p = 0; p < 5; ++p) pool.fetch(p);  // page 0 makes room for 4
+        pool.fetch(1);
+        pool.fetch(5);
+        size_t misses = pool.statistics().misses;
+        pool.fetch(1);
+        if (pool.statistics().misses != misses) return "CLOCK evicted a page used since the hand passed";
+    }
+    {
+        BufferPool pool(file, 4, 0);
+        for (uint32_t p = 10; p < 14; ++p) pool.fetch(p).mutableData()[0] = 'Z';
+        for (uint32_t p = 20; p < 24; ++p) pool.fetch(p);
+        if (pool.statistics().writes != 4 || pool.statistics().evictions != 4) return "evicted pages not written back";
+        pool.fetch(30).mutableData()[0] = 'Z';
+        if (!pool.flush() || pool.statistics().writes != 5) return "flush did not write the changed page";
+    }
+    for (uint32_t p : {10, 13, 30, 31}) {
+        if (!file.read(p, {buf.data()}) || (buf[0] == 'Z') != (p != 31) || buf[1] != static_cast<char>('a' + p % 26)) {
+            return "page " + std::to_string(p) + " wrong on disk";
+        }
+    }
+    file.close();
+
+    std::string storePath = (dir / "tasks.db").string();
+    {
+        auto store = PagedTaskStore::create(storePath, 64);
+        if (!store) return "create failed";
+        for (int id = 1; id <= 20000; ++id) {
+            if (!store->append(Task(id, "task " + std::to_string(id), ""))) return "append failed";
+        }
+        if (!store->flush()) return "flush failed";
+    }
+    auto store = PagedTaskStore::open(storePath, 16, false);
+    if (!store) return "reopen failed";
+    size_t before = store->poolStats().misses;
+    Task t;
+    if (!store->get(12345, t) || t.getTitle() != "task 12345") return "get failed";
+    if (store->poolStats().misses - before > 4) {
+        return "a cold lookup read " + std::to_string(store->poolStats().misses - before) + " pages";
+    }
+    size_t reads = store->poolStats().reads, seen = 0;
+    if (!store->scan([&](PagedTaskStore::RecordId, const Task&) { ++seen; }) || seen != 20000) return "scan failed";
+    if ((store->poolStats().reads - reads) * 3 > store->pageCount()) return "a scan did not read ahead";
+    return "";
+}
+
+// Importers: todo.txt dates, priorities and tags, and iCalendar folding,
+// escapes, quoted parameters, nested components and completion all map
+// to the expected tasks, which get fresh ids and survive a save
+static std::string checkImporters(const std::filesystem::path& dir) {
+    const std::string todoTxt =
+        "x 2024-03-02 2024-03-01 Pay rent +home due:2024-03-05\n"
+        "(A) 2024-01-01 Call  mom @phone\n"
+        "\n"
+        "Buy milk pri:C\r\n"
+        "due:2024-04-01 Write report\n"
+        "due:2024-04-01 pri:B\n"
+        "x done\n"
+        "xylophone lesson\n"
+        "   Plain task   ";
+    const std::string ics =
+        "BEGIN:VCALENDAR\r\n"
+        "BEGIN:VEVENT\r\nSUMMARY:not a todo\r\nEND:VEVENT\r\n"
+        "BEGIN:VTODO\r\n"
+        "SUMMARY:Fix the\\, roof\r\n"
+        "DESCRIPTION;ALTREP=\"cid:a:b\":line one\\nline\r\n"
+        "  two\\\\ and\\; more\\\r\n"
+        "PRIORITY:2\r\nDUE;VALUE=DATE:20240315\r\nSTATUS:COMPLETED\r\n"
+        "BEGIN:VALARM\r\nSUMMARY:alarm text\r\nEND:VALARM\r\n"
+        "END:VTODO\r\n"
+        "begin:vtodo\r\ndescription:First line\\nsecond\r\npercent-complete:100\r\nend:vtodo\r\n"
+        "BEGIN:VTODO\r\nSUMMARY:\r\nEND:VTODO\r\n"
+        "END:VCALENDAR\r\n";
+    const std::vector<std::string> expected = {
+        "1|existing||0",
+        "2|Pay rent +home|due:2024-03-05|1",
+        "3|Call mom @phone|priority:A|0",
+        "4|Buy milk|priority:C|0",
+        "5|Write report|due:2024-04-01|0",
+        "6|done||1",
+        "7|xylophone lesson||0",
+        "8|Plain task||0",
+        "9|Fix the, roof|priority:B due:2024-03-15\nline one\nline two\\ and; more\\|1",
+        "10|First line|First line\nsecond|1",
+    };
+    if (ICalendarReader::looksLike(todoTxt) || !ICalendarReader::looksLike("\xEF\xBB\xBF begin:vcalendar\r\n")) {
+        return "format detection is wrong";
+    }
+    std::string path = (dir / "tasks.csv").string();
+    auto contents = [](TaskManager& m) {
+        std::vector<std::string> out;
+        for (const auto& t : m.list()) {
+            out.push_back(std::to_string(t.getId()) + "|" + std::string(t.getTitle()) + "|" +
+                          std::string(t.getNotes()) + "|" + (t.isCompleted() ? "1" : "0"));
+        }
+        return out;
+    };
+    {
+        TaskManager m(path);
+        m.enableJournal();
+        m.addTask("existing", "");
+        if (importTasks<TodoTxtReader>(m, todoTxt) != 7) return "todo.txt import count is wrong";
+        if (importTasks<ICalendarReader>(m, ics) != 2) return "iCalendar import count is wrong";
+        if (contents(m) != expected) return "imported tasks differ";
+        if (!m.save()) return "save failed";
+    }
+    TaskManager m(path);
+    m.enableJournal();
+    if (!m.load() || contents(m) != expected || m.addTask("next", "") != 11) return "imported tasks lost on reload";
+    return "";
+}
+
+struct SelfCheck {
+    const char* name;
+    std::string (*run)(const std::filesystem::path& dir);
+};
+
+static const SelfCheck kSelfChecks[] = {
+    {"load-by-id", checkLoadById},
+    {"sync-reimport", checkSyncReimport},
+    {"sync-id-reuse", checkSyncIdReuse},
+    {"sync-lost-delta", checkSyncLostDelta},
+    {"merge", checkMerge},
+    {"allocations", checkAllocations},
+    {"line-cache", checkLineCache},
+    {"parallel-save", checkParallelSave},
+    {"cas-reload", checkCasReload},
+    {"csv-scanner", checkCsvScanner},
+    {"workspace", checkWorkspace},
+    {"journal", checkJournal},
+    {"parallel-replay", checkParallelReplay},
+    {"arrow-round-trip", checkArrowRoundTrip},
+    {"query", checkQuery},
+    {"index-file", checkIndexFile},
+    {"background-index", checkBackgroundIndex},
+    {"elias-fano", checkEliasFano},
+    {"paged-store", checkPagedStore},
+    {"blobs", checkBlobs},
+    {"snapshots", checkSnapshots},
+    {"external-sort", checkExternalSort},
+    {"buffer-pool", checkBufferPool},
+    {"importers", checkImporters},
+};
+
+// A fresh directory under the system's temporary one
+static std::filesystem::path scratchDir(const std::string& what) {
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec) /
+                                ("todo-" + what + "-" + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+static int runSelfTest(const std::string& only) {
+    std::error_code ec;
+    std::filesystem::path root = scratchDir("selftest");
+    int failed = 0, ran = 0;
+    for (const SelfCheck& check : kSelfChecks) {
+        if (!only.empty() && only != check.name) continue;
+        std::filesystem::path dir = root / check.name;
+        std::filesystem::create_directories(dir, ec);
+        std::string error = check.run(dir);
+        std::cout << (error.empty() ? "ok    " : "FAIL  ") << check.name;
+        if (!error.empty()) std::cout << ": " << error;
+        std::cout << "\n";
+        failed += !error.empty();
+        ++ran;
+    }
+    std::filesystem::remove_all(root, ec);
+    if (ran == 0) {
+        std::cerr << "No check named " << only << ".\n";
+        return 2;
+    }
+    std::cout << (ran - failed) << " of " << ran << " checks passed\n";
+    return failed ? 1 : 0;
+}
+
+// Benchmarks behind `todo bench NAME [N]`, for comparing backends and
+// representations on the machine at hand. Each prints a small table;
+// N scales the workload.
+static double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Default, pooled and monotonic resources under a TaskManager: loading a
+// file, adding as many tasks again, churning (clearing everything and
+// adding it back, so freed memory is reused) and tearing down
+static void benchAllocators(size_t n, const std::filesystem::path& dir) {
+    std::string path = (dir / "tasks.csv").string();
+    std::vector<std::string> titles, notes;
+    for (size_t i = 0; i < n; ++i) {
+        titles.push_back("task number " + std::to_string(i) + " with a title kept out of line");
+        notes.push_back("notes for task " + std::to_string(i));
+    }
+    {
+        TaskManager m(path);
+        for (size_t i = 0; i < n; ++i) m.addTask(titles[i], notes[i]);
+        m.save();
+    }
+    std::cout << "resource        load ms    add ms  churn ms   free ms\n";
+    auto run = [&](const char* name, std::unique_ptr<std::pmr::memory_resource> owned) {
+        std::pmr::memory_resource* res = owned ? owned.get() : std::pmr::new_delete_resource();
+        double ms[4];
+        auto start = std::chrono::steady_clock::now();
+        auto m = std::make_unique<TaskManager>(path, res);
+        m->load();
+        ms[0] = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < n; ++i) m->addTask(titles[i], notes[i]);
+        ms[1] = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        m->clearAll();
+        for (size_t i = 0; i < n; ++i) m->addTask(titles[i], notes[i]);
+        ms[2] = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        m.reset();
+        owned.reset();
+        ms[3] = millisSince(start);
+        std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1);
+        for (double v : ms) std::cout << std::setw(10) << v;
+        std::cout << "\n";
+    };
+    run("default", nullptr);
+    run("pool", std::make_unique<std::pmr::unsynchronized_pool_resource>());
+    run("monotonic", std::make_unique<std::pmr::monotonic_buffer_resource>(size_t(1) << 20));
+}
+
+// The chunked store TaskManager keeps against the persistent trie behind
+// TaskHistory: random lookups, and random edits with a version kept every
+// 100 edits (a snapshot of the store, a copy of the trie's root). Edits on
+// the store find their task by scanning, so the random work is capped.
+static void benchHistory(size_t n, const std::filesystem::path& dir) {
+    constexpr size_t kVersionEvery = 100;
+    const size_t ops = std::min<size_t>(n, 2000);
+    std::mt19937 rng(42);
+    std::vector<int> ids(ops);
+    for (int& id : ids) id = static_cast<int>(rng() % n) + 1;
+    std::vector<std::string> titles(ops);
+    for (size_t i = 0; i < ops; ++i) titles[i] = "edited title number " + std::to_string(i) + " kept out of line";
+
+    std::cout << "backend      build ms  lookup ns  update ns  KB/version\n";
+    auto report = [&](const char* name, double build, double lookup, double update, size_t versionBytes) {
+        std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(9) << build << std::setw(11) << lookup * 1e6 / ops << std::setw(11)
+                  << update * 1e6 / ops << std::setw(12) << versionBytes / 1024.0 / (ops / kVersionEvery) << "\n";
+    };
+    size_t found = 0;
+    {
+        CountingResource mem;
+        auto start = std::chrono::steady_clock::now();
+        TaskManager m((dir / "tasks.csv").string(), &mem);
+        for (size_t i = 0; i < n; ++i) m.addTask("task number " + std::to_string(i), "");
+        double build = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        for (int id : ids) found += m.find(id) != nullptr;
+        double lookup = millisSince(start);
+        std::vector<TaskSnapshot> versions;
+        size_t before = mem.bytes;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            m.editTask(ids[i], titles[i], "");
+            if (i % kVersionEvery == kVersionEvery - 1) versions.push_back(m.list());
+        }
+        double update = millisSince(start);
+        report("chunks", build, lookup, update, mem.bytes - before);
+    }
+    {
+        CountingResource mem;
+        auto start = std::chrono::steady_clock::now();
+        PersistentTaskMap map(&mem);
+        for (size_t i = 0; i < n; ++i) {
+            map = map.set(Task(static_cast<int>(i + 1), "task number " + std::to_string(i), ""));
+        }
+        double build = millisSince(start);
+        start = std::chrono::steady_clock::now();
+        for (int id : ids) found += map.find(id) != nullptr;
+        double lookup = millisSince(start);
+        std::vector<PersistentTaskMap> versions;
+        size_t before = mem.bytes;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ops; ++i) {
+            Task t = *map.find(ids[i]);
+            t.setTitle(titles[i]);
+            map = map.set(t);
+            if (i % kVersionEvery == kVersionEvery - 1) versions.push_back(map);
+        }
+        double update = millisSince(start);
+        report("trie", build, lookup, update, mem.bytes - before);
+    }
+    if (found != 2 * ops) std::cout << "(lookups missed " << 2 * ops - found << " tasks)\n";
+}
+
+// Posting list codings on one list of N ids with about 10% gaps, as left
+// by deletions: sizes, Elias-Fano encode, random rank and sequential
+// decode, against sequential decode of the same list as delta + varint
+static void benchPostings(size_t n, const std::filesystem::path&) {
+    std::mt19937 rng(42);
+    std::vector<uint32_t> ids;
+    ids.reserve(n);
+    for (uint32_t id = 1; ids.size() < n; ++id) {
+        if (rng() % 10) ids.push_back(id);
+    }
+    std::string varint;
+    uint32_t last = 0;
+    for (uint32_t id : ids) {
+        putVarint(varint, id - last);
+        last = id;
+    }
+
+    std::pmr::vector<uint64_t> arena;
+    auto start = std::chrono::steady_clock::now();
+    EliasFano::Writer out(arena, 0);
+    EliasFano::List list = EliasFano::append(out, ids.data(), ids.size());
+    double encode = millisSince(start);
+
+    constexpr size_t kQueries = 1000000;
+    std::vector<uint32_t> targets(kQueries);
+    for (uint32_t& t : targets) t = static_cast<uint32_t>(rng() % (ids.back() + 1));
+    uint64_t sum = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t t : targets) sum += EliasFano::rank(arena.data(), list, t);
+    double rank = millisSince(start);
+
+    start = std::chrono::steady_clock::now();
+    EliasFano::forEach(arena.data(), list, [&](uint32_t id) { sum += id; });
+    double scan = millisSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> decoded;
+    decoded.reserve(n);
+    const char* p = varint.data();
+    const char* end = p + varint.size();
+    uint32_t id = 0, gap = 0;
+    while (p < end && getVarint(p, end, gap)) decoded.push_back(id += gap);
+    double varintScan = millisSince(start);
+
+    double mb = 1024.0 * 1024.0;
+    std::cout << std::fixed << std::setprecision(1) << "plain uint32    " << std::setw(9) << n * 4 / mb << " MB\n"
+              << "elias-fano      " << std::setw(9) << arena.size() * 8 / mb << " MB  " << std::setprecision(2)
+              << arena.size() * 64.0 / n << " bits/id\n"
+              << std::setprecision(1) << "delta+varint    " << std::setw(9) << varint.size() / mb << " MB\n"
+              << "encode          " << std::setw(9) << encode << " ms\n"
+              << "random rank     " << std::setw(9) << rank * 1e6 / kQueries << " ns\n"
+              << "sequential      " << std::setw(9) << scan * 1e6 / n << " ns/id\n"
+              << "varint decode   " << std::setw(9) << varintScan * 1e6 / n << " ns/id\n";
+    if (decoded != ids || sum == 0) std::cout << "(round trip failed)\n";
+}
+
+struct Bench {
+    const char* name;
+    size_t defaultN;
+    void (*run)(size_t n, const std::filesystem::path& dir);
+};
+
+static const Bench kBenches[] = {
+    {"allocators", 200000, benchAllocators},
+    {"history", 100000, benchHistory},
+    {"postings", 10000000, benchPostings},
+};
+
+static int runBench(const std::string& name, const std::string& count) {
+    for (const Bench& bench : kBenches) {
+        if (name != bench.name) continue;
+        int n = static_cast<int>(bench.defaultN);
+        if (!count.empty() && (!parseInt(count, n) || n <= 0)) break;
+        std::filesystem::path dir = scratchDir("bench");
+        std::cout << bench.name << ", N = " << n << "\n";
+        bench.run(static_cast<size_t>(n), dir);
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+        return 0;
+    }
+    std::cerr << "Benchmarks:";
+    for (const Bench& bench : kBenches) std::cerr << " " << bench.name;
+    std::cerr << "\n";
+    return 2;
+}
+
+static void printUsage() {
+    std::cout << "Usage:\n"
+              << "  todo                                 interactive menu\n"
+              << "  todo diff OLD NEW                    show changes between two task files\n"
+              << "  todo merge OURS THEIRS OUT           merge two task files\n"
+              << "  todo merge BASE OURS THEIRS OUT      3-way merge against a common base\n"
+              << "  todo sync-export TASKS PEER DELTA    write changes since the last sync with PEER\n"
+              << "  todo sync-import TASKS DELTA         merge a delta from another replica\n"
+              << "  todo snapshot TASKS [NAME]           back up TASKS (deduplicated)\n"
+              << "  todo snapshots TASKS                 list backups of TASKS\n"
+              << "  todo restore TASKS NAME              put a backup of TASKS back\n"
+              << "  todo sort IN OUT [--by id|title|status] [--unique] [--memory MB] [--format csv|escaped]\n"
+              << "                                       sort a task file of any size\n"
+              << "  todo pack TASKS OUT                  convert TASKS to the paged binary format\n"
+              << "  todo query FILE QUERY [--pool PAGES] search a paged file in bounded memory\n"
+              << "  todo show FILE ID [LAST]             print tasks of a paged file by id\n"
+              << "  todo edit FILE add TITLE [NOTES] | toggle ID | remove ID\n"
+              << "                                       change one task of a paged file in place\n"
+              << "  todo import TASKS FILE               add tasks from a todo.txt or .ics file\n"
+              << "  todo export-arrow TASKS OUT [--stream]\n"
+              << "                                       write tasks as an Arrow IPC file or stream\n"
+              << "  todo selftest [NAME]                 run the built-in regression checks\n"
+              << "  todo bench NAME [N]                  run a benchmark (allocators, history, postings)\n"
+              << "  todo apply DIR SCRIPT [--memory MB]  apply an edit script (- for stdin) to the lists in DIR\n";
 }
 
-int main() {
-    TaskManager manager("tasks.csv");
-    // Auto load on start for convenience
+// Command-line tools; returns the process exit code
+static int runCommand(const std::vector<std::string>& args) {
+    const std::string& cmd = args[0];
+    if (cmd == "diff" && args.size() == 3) {
+        return runDiff(args[1], args[2]);
+    } else if (cmd == "merge" && args.size() == 4) {
+        return runMerge(nullptr, args[1], args[2], args[3]);
+    } else if (cmd == "merge" && args.size() == 5) {
+        return runMerge(&args[1], args[2], args[3], args[4]);
+    } else if (cmd == "sync-export" && args.size() == 4) {
+        return runSyncExport(args[1], args[2], args[3]);
+    } else if (cmd == "sync-import" && args.size() == 3) {
+        return runSyncImport(args[1], args[2]);
+    } else if (cmd == "snapshot" && (args.size() == 2 || args.size() == 3)) {
+        return runSnapshot(args[1], args.size() == 3 ? args[2] : "");
+    } else if (cmd == "snapshots" && args.size() == 2) {
+        return runListSnapshots(args[1]);
+    } else if (cmd == "restore" && args.size() == 3) {
+        return runRestore(args[1], args[2]);
+    } else if (cmd == "sort" && args.size() >= 3) {
+        int rc = runSort(args);
+        if (rc != 2) return rc;
+    } else if (cmd == "pack" && args.size() == 3) {
+        return runPack(args[1], args[2]);
+    } else if (cmd == "query" && (args.size() == 3 || (args.size() == 5 && args[3] == "--pool"))) {
+        int pages = 256;
+        if (args.size() == 3 || (parseInt(args[4], pages) && pages > 0)) {
+            return runQuery(args[1], args[2], static_cast<size_t>(pages));
+        }
+    } else if (cmd == "export-arrow" && (args.size() == 3 || (args.size() == 4 && args[3] == "--stream"))) {
+        return runExportArrow(args[1], args[2], args.size() == 4);
+    } else if (cmd == "bench" && (args.size() == 2 || args.size() == 3)) {
+        return runBench(args[1], args.size() == 3 ? args[2] : "");
+    } else if (cmd == "selftest" && args.size() <= 2) {
+        return runSelfTest(args.size() == 2 ? args[1] : "");
+    } else if (cmd == "apply" && (args.size() == 3 || (args.size() == 5 && args[3] == "--memory"))) {
+        int mb = 64;
+        if (args.size() == 3 || (parseInt(args[4], mb) && mb > 0)) {
+            return runApply(args[1], args[2], static_cast<size_t>(mb));
+        }
+    } else if (cmd == "import" && args.size() == 3) {
+        return runImport(args[1], args[2]);
+    } else if (cmd == "edit" && args.size() >= 4 && args.size() <= 5
+               && (args[2] == "add" || (args.size() == 4 && (args[2] == "toggle" || args[2] == "remove")))) {
+        return runPagedEdit(args[1], args[2], args[3], args.size() == 5 ? args[4] : "");
+    } else if (cmd == "show" && (args.size() == 3 || args.size() == 4)) {
+        int lo = 0, hi = 0;
+        if (parseInt(args[2], lo) && (args.size() == 3 ? (hi = lo, true) : parseInt(args[3], hi))) {
+            return runShow(args[1], lo, hi);
+        }
+    }
+    printUsage();
+    return cmd == "help" || cmd == "--help" ? 0 : 2;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        return runCommand(std::vector<std::string>(argv + 1, argv + argc));
+    }
+
+    // The menu loop is long-lived and churns small strings, so pool them.
+    // Synchronized because snapshots may be released by a saver thread.
+    std::pmr::synchronized_pool_resource pool;
+    TaskManager manager("tasks.csv", &pool);
+    manager.setSaveThreads(std::thread::hardware_concurrency());
+    // Every change is journaled, so quitting without a save (or a crash)
+    // loses nothing; a save every 1000 changes keeps startup replay short
+    manager.enableJournal();
+    manager.setCheckpointInterval(1000);
+    // Auto load on start for convenience. By-id operations work as soon as
+    // the tasks are in; secondary indexes finish in the background.
     manager.load();
+    manager.buildIndexesInBackground();
+    // Every save this session becomes a version to look back at (History)
+    manager.enableHistory();
 
     while (true) {
         printMenu();
-        int choice = readInt("Choose an option [1-9]: ");
+        int choice = readInt("Choose an option [1-13]: ");
         std::cout << "\n";
 
         if (choice == 1) {
@@ -332,6 +8853,16 @@ int main() {
             manager.save();
             std::cout << "Goodbye.\n";
             break;
+        } else if (choice == 10) {
+            std::string query = readLine("Search (title words, notes:word, status:open|done): ");
+            std::vector<int> ids = manager.query(query);
+            printTasks(manager.list(), &ids);
+        } else if (choice == 11) {
+            printTasksInOrder(manager.list(), manager.idsByTitle());
+        } else if (choice == 12) {
+            printStats(manager);
+        } else if (choice == 13) {
+            printHistory(manager.enableHistory());
         } else {
             std::cout << "Invalid choice.\n\n";
         }